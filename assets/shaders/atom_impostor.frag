@@ -0,0 +1,64 @@
+#version 460
+
+layout (constant_id = 0) const uint POINT_LIGHT_COUNT = 1;
+layout (constant_id = 1) const uint MOUSE_BUCKET_COUNT = 1;
+layout (constant_id = 2) const bool ISOMETRIC = false;
+
+layout (location = 0) in vec3 inPosition;   // in World Space, on the quad
+layout (location = 1) in flat vec3 inCenter;
+layout (location = 2) in flat float inRadius;
+layout (location = 3) in flat vec3 inColor;
+layout (location = 4) in flat uint inID;
+layout (location = 5) in flat uint batchID;
+
+layout (location = 0) out vec4 outColor;
+
+// the sphere is behind the quad, so the depth of the hit is never smaller than the one of the quad
+// and early depth tests against the quad stay valid
+layout (depth_greater) out float gl_FragDepth;
+
+#include "buffers.vert"
+#include "utils.frag"
+
+void main()
+{
+    vec3 rayDirection = ISOMETRIC ? -normalize(vec3(cam_ubo.direction_of_light))
+                                  : normalize(inPosition - vec3(cam_ubo.camera_positionW));
+
+    // ray sphere intersection, the ray starts on the quad
+    vec3 toOrigin = inPosition - inCenter;
+    float b = dot(toOrigin, rayDirection);
+    float c = dot(toOrigin, toOrigin) - inRadius * inRadius;
+    float discriminant = b * b - c;
+    if (discriminant < 0.f) discard;
+    vec3 hitPosition = inPosition + rayDirection * (-b - sqrt(discriminant));
+    vec3 normal = (hitPosition - inCenter) / inRadius;
+
+    vec4 hitClip = cam_ubo.projViewMat * vec4(hitPosition, 1.f);
+    float depth = hitClip.z / hitClip.w;
+    gl_FragDepth = depth;
+
+    vec3 linear_out_color;
+    if (ISOMETRIC) {
+        linear_out_color = BlinnPhongIso(scene_ubo.ambient_light, scene_ubo.point_lights,
+                                         hitPosition, normal, inColor,
+                                         scene_ubo.params[batchID][1],
+                                         scene_ubo.params[batchID][2],
+                                         scene_ubo.params[batchID][3],
+                                         vec3(cam_ubo.camera_positionW),
+                                         vec3(cam_ubo.direction_of_light));
+    } else {
+        linear_out_color = BlinnPhong(scene_ubo.ambient_light, scene_ubo.point_lights,
+                                      hitPosition, normal, inColor,
+                                      scene_ubo.params[batchID][1],
+                                      scene_ubo.params[batchID][2],
+                                      scene_ubo.params[batchID][3],
+                                      vec3(cam_ubo.camera_positionW));
+    }
+    outColor = vec4(CorrectGamma(linear_out_color, scene_ubo.params[batchID][0]), 1.f);
+
+    uint bucketIndex = uint(depth * MOUSE_BUCKET_COUNT);
+    if(length(scene_ubo.mouse_coords - gl_FragCoord.xy) < 1){
+        buckets.arr[bucketIndex] = inID;
+    }
+}
@@ -0,0 +1,56 @@
+#version 460
+
+// atoms as impostors: a quad in front of the sphere that covers it on screen, atom_impostor.frag casts a ray
+// against the sphere per fragment. the vertex positions of the quad mesh are its corners in [-1, 1]
+
+layout (constant_id = 0) const uint POINT_LIGHT_COUNT = 1;
+layout (constant_id = 2) const bool ISOMETRIC = false;
+
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexNormal;
+layout (location = 2) in vec3 vertexColor;
+
+layout (location = 0) out vec3 outPosition;
+layout (location = 1) out flat vec3 outCenter;
+layout (location = 2) out flat float outRadius;
+layout (location = 3) out flat vec3 outColor;
+layout (location = 4) out flat uint outID;
+layout (location = 5) out flat uint batchID;
+
+#include "buffers.vert"
+
+void main()
+{
+    const FinalInstance instance = final_instances.data[gl_InstanceIndex];
+    uint objectID = instance.objectID;
+    uint offsetID = instance.offsetID;
+    mat4 model_matrix = object_buffer.objects[objectID].model_matrix;
+    vec3 center = vec3(model_matrix[3] + offsets.data.offsets[offsetID]);
+    float radius = object_buffer.objects[objectID].radius;
+
+    // the quad faces the camera and touches the sphere at its nearest point, so the whole sphere is behind it.
+    // in perspective it only has to cover the cone from the camera to the silhouette of the sphere
+    vec3 direction;
+    float halfSize = radius;
+    if (ISOMETRIC) {
+        direction = -normalize(vec3(cam_ubo.direction_of_light));
+    } else {
+        vec3 toCenter = center - vec3(cam_ubo.camera_positionW);
+        float distance = length(toCenter);
+        direction = toCenter / distance;
+        halfSize = radius * sqrt(max(distance - radius, 0.f) / (distance + radius));
+    }
+    vec3 upHint = abs(direction.y) < 0.99f ? vec3(0.f, 1.f, 0.f) : vec3(1.f, 0.f, 0.f);
+    vec3 right = normalize(cross(direction, upHint));
+    vec3 up = cross(right, direction);
+
+    // a camera inside the sphere gives an empty quad
+    vec3 positionW = center - direction * radius + (right * vertexPosition.x + up * vertexPosition.y) * halfSize;
+    gl_Position = cam_ubo.projViewMat * vec4(positionW, 1.f);
+    outPosition = positionW;
+    outCenter = center;
+    outRadius = radius;
+    outColor = vec3(object_buffer.objects[objectID].color1);
+    outID = objectID;
+    batchID = object_buffer.objects[objectID].batchID;
+}
@@ -0,0 +1,79 @@
+#version 460
+
+layout (constant_id = 0) const uint POINT_LIGHT_COUNT = 1;
+layout (constant_id = 2) const bool ISOMETRIC = false;
+
+layout (location = 0) in vec3 inPosition;   // in World Space, on the box
+layout (location = 1) in flat vec3 inCenter;
+layout (location = 2) in flat vec3 inAxis;
+layout (location = 3) in flat float inHalfLength;
+layout (location = 4) in flat float inRadius;
+layout (location = 5) in flat vec3 inColor1;
+layout (location = 6) in flat vec3 inColor2;
+layout (location = 7) in flat vec3 inBondNormal;
+layout (location = 8) in flat uint batchID;
+
+layout (location = 0) out vec4 outColor;
+
+#include "buffers.vert"
+#include "utils.frag"
+
+void main()
+{
+    vec3 rayDirection = ISOMETRIC ? -normalize(vec3(cam_ubo.direction_of_light))
+                                  : normalize(inPosition - vec3(cam_ubo.camera_positionW));
+
+    // ray cylinder intersection in the plane orthogonal to the axis. front and back faces of the box are
+    // rasterized, the first intersection along the ray is the visible one for both
+    vec3 toOrigin = inPosition - inCenter;
+    float originAlongAxis = dot(toOrigin, inAxis);
+    float directionAlongAxis = dot(rayDirection, inAxis);
+    vec3 radialOrigin = toOrigin - inAxis * originAlongAxis;
+    vec3 radialDirection = rayDirection - inAxis * directionAlongAxis;
+
+    float a = dot(radialDirection, radialDirection);
+    float b = dot(radialOrigin, radialDirection);
+    float c = dot(radialOrigin, radialOrigin) - inRadius * inRadius;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.f) discard;
+
+    float t = a > 1e-8f ? (-b - sqrt(discriminant)) / a : 0.f;
+    float hitAlongAxis = originAlongAxis + t * directionAlongAxis;
+    vec3 normal;
+    if (a > 1e-8f && abs(hitAlongAxis) <= inHalfLength) {
+        normal = (radialOrigin + t * radialDirection) / inRadius;
+    } else {
+        // the ray passes the side outside of the bond, it can still enter through the cap facing it
+        float capSide = directionAlongAxis > 0.f ? -1.f : 1.f;
+        t = (capSide * inHalfLength - originAlongAxis) / directionAlongAxis;
+        vec3 radialHit = radialOrigin + t * radialDirection;
+        if (dot(radialHit, radialHit) > inRadius * inRadius) discard;
+        normal = inAxis * capSide;
+    }
+    vec3 hitPosition = inPosition + rayDirection * t;
+
+    vec4 hitClip = cam_ubo.projViewMat * vec4(hitPosition, 1.f);
+    gl_FragDepth = hitClip.z / hitClip.w;
+
+    bool isLeft = (dot((hitPosition - inCenter), inBondNormal)) > 0;
+    vec3 bondColor = mix(inColor1, inColor2, float(isLeft));
+
+    vec3 linear_out_color;
+    if (ISOMETRIC) {
+        linear_out_color = BlinnPhongIso(scene_ubo.ambient_light, scene_ubo.point_lights,
+                                         hitPosition, normal, bondColor,
+                                         scene_ubo.params[batchID][1],
+                                         scene_ubo.params[batchID][2],
+                                         scene_ubo.params[batchID][3],
+                                         vec3(cam_ubo.camera_positionW),
+                                         vec3(cam_ubo.direction_of_light));
+    } else {
+        linear_out_color = BlinnPhong(scene_ubo.ambient_light, scene_ubo.point_lights,
+                                      hitPosition, normal, bondColor,
+                                      scene_ubo.params[batchID][1],
+                                      scene_ubo.params[batchID][2],
+                                      scene_ubo.params[batchID][3],
+                                      vec3(cam_ubo.camera_positionW));
+    }
+    outColor = vec4(CorrectGamma(linear_out_color, scene_ubo.params[batchID][0]), 1.f);
+}
@@ -0,0 +1,45 @@
+#version 460
+
+// bonds as impostors: the box around the bond cylinder is rasterized and bond_impostor.frag casts a ray against
+// the cylinder per fragment. the vertex positions of the box mesh are its corners in [-1, 1]
+
+layout (constant_id = 0) const uint POINT_LIGHT_COUNT = 1;
+
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexNormal;
+layout (location = 2) in vec3 vertexColor;
+
+layout (location = 0) out vec3 outPosition;
+layout (location = 1) out flat vec3 outCenter;
+layout (location = 2) out flat vec3 outAxis;
+layout (location = 3) out flat float outHalfLength;
+layout (location = 4) out flat float outRadius;
+layout (location = 5) out flat vec3 outColor1;
+layout (location = 6) out flat vec3 outColor2;
+layout (location = 7) out flat vec3 outBondNormal;
+layout (location = 8) out flat uint batchID;
+
+#include "buffers.vert"
+
+void main()
+{
+    const FinalInstance instance = final_instances.data[gl_InstanceIndex];
+    uint objectID = instance.objectID;
+    uint offsetID = instance.offsetID;
+
+    // the model matrix scales the mesh by the bond length along y and by the bond thickness along x and z
+    mat4 model_matrix = object_buffer.objects[objectID].model_matrix;
+    vec3 boxCorner = vertexPosition * vec3(RCC_BOND_MESH_RADIUS, RCC_BOND_MESH_HALF_LENGTH, RCC_BOND_MESH_RADIUS);
+    vec4 vertexPositionWorld = model_matrix * vec4(boxCorner, 1.f) + offsets.data.offsets[offsetID];
+
+    gl_Position = cam_ubo.projViewMat * vertexPositionWorld;
+    outPosition = vec3(vertexPositionWorld);
+    outCenter = vec3(model_matrix[3] + offsets.data.offsets[offsetID]);
+    outAxis = normalize(vec3(model_matrix[1]));
+    outHalfLength = length(vec3(model_matrix[1])) * RCC_BOND_MESH_HALF_LENGTH;
+    outRadius = length(vec3(model_matrix[0])) * RCC_BOND_MESH_RADIUS;
+    outColor1 = vec3(object_buffer.objects[objectID].color1);
+    outColor2 = vec3(object_buffer.objects[objectID].color2);
+    outBondNormal = vec3(object_buffer.objects[objectID].bond_normal);
+    batchID = object_buffer.objects[objectID].batchID;
+}
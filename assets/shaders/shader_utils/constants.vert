@@ -2,5 +2,34 @@
 #define SHADER_CONSTANTS
 
 #define RCC_MESH_COUNT 5
+// detail levels per mesh, see GPUDrawCalls in utils.hpp
+#define RCC_LOD_COUNT 4
+// pipelines the draw commands are sorted into, see DrawGroup in engine.hpp
+#define RCC_DRAW_GROUP_COUNT 4
+
+// consecutive instances that are culled together before the single objects are tested, see culling.comp
+#define RCC_CLUSTER_SIZE 64
+// smallest maxComputeWorkGroupCount[0] the spec allows
+#define RCC_MAX_WORKGROUP_COUNT 65535u
+
+// culling passes, see Engine::runCullComputeShader. early and late are used with occlusion culling
+#define RCC_CULL_SINGLE_PASS 0u
+#define RCC_CULL_EARLY 1u
+#define RCC_CULL_LATE 2u
+
+// mesh ids, see meshID in mesh.hpp
+#define RCC_MESH_ATOM 0u
+#define RCC_MESH_BOND 4u
+
+// extent of bond.obj along its axis (y) and around it, the bond impostors are cast against the same cylinder
+#define RCC_BOND_MESH_HALF_LENGTH 0.85f
+#define RCC_BOND_MESH_RADIUS 0.2f
+
+// atom tags, see Tags in visualization_data.hpp
+#define RCC_TAG_CATALYST (1u << 30)
+#define RCC_TAG_CHEMICAL (1u << 29)
+#define RCC_TAG_HIGHLIGHTED (1u << 27)
+#define RCC_TAG_SELECTED_FOR_MEASUREMENT (1u << 26)
+#define RCC_TAG_SELECTED_FOR_TAGGING (1u << 8)
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef SHADER_OCCLUSION
+#define SHADER_OCCLUSION
+
+// true if the sphere lies completely behind the depths stored in the depth pyramid.
+// the screen rectangle and the nearest depth come from the corners of the view space box around the sphere,
+// that works for the perspective and the isometric camera alike
+bool isOccluded(sampler2D depthPyramid, mat4 view, mat4 projection, vec3 center, float radius){
+    vec3 centerV = vec3(view * vec4(center, 1.f));
+    vec2 uvMin = vec2(1.f);
+    vec2 uvMax = vec2(0.f);
+    float nearestDepth = 1.f;
+    for(int i = 0; i < 8; i++){
+        vec3 corner = centerV + radius * vec3((i & 1) != 0 ? 1.f : -1.f,
+                                              (i & 2) != 0 ? 1.f : -1.f,
+                                              (i & 4) != 0 ? 1.f : -1.f);
+        vec4 clip = projection * vec4(corner, 1.f);
+        // spheres reaching behind the near plane can't be tested
+        if(clip.w <= 0.f || clip.z < 0.f) return false;
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5f + 0.5f;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+    // the part outside of the screen is left to the frustum test
+    uvMin = clamp(uvMin, 0.f, 1.f);
+    uvMax = clamp(uvMax, 0.f, 1.f);
+
+    // the level in which the rectangle covers at most 2x2 texels
+    vec2 sizeTexels = (uvMax - uvMin) * vec2(textureSize(depthPyramid, 0));
+    int level = int(ceil(log2(max(max(sizeTexels.x, sizeTexels.y), 1.f))));
+    level = clamp(level, 0, textureQueryLevels(depthPyramid) - 1);
+    ivec2 levelSize = textureSize(depthPyramid, level);
+    ivec2 first = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 last = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthestDepth = 0.f;
+    for(int y = first.y; y <= last.y; y++){
+        for(int x = first.x; x <= last.x; x++){
+            farthestDepth = max(farthestDepth, texelFetch(depthPyramid, ivec2(x, y), level).r);
+        }
+    }
+    return nearestDepth > farthestDepth;
+}
+
+#endif
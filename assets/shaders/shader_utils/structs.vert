@@ -29,6 +29,7 @@ struct DrawIndexedIndirectCommand{
 
 struct CullData{
     mat4 viewMatrix;
+    mat4 projectionMatrix;
     vec4 frustumNormalEquations[6];
     vec4 cylinderCenter;
     vec4 cylinderNormal;
@@ -38,6 +39,8 @@ struct CullData{
     uint offsetCount;
     bool isCullingEnabled;
     bool cullCylinder;
+    float lodScale;
+    float lodErrorThreshold;
 };
 
 struct Instance{
@@ -48,6 +51,45 @@ struct FinalInstance{
     uint objectID;
     uint offsetID;
 };
+struct VisibleCluster{
+    uint clusterID;
+    uint offsetID;
+};
+// indirect dispatch of the object culling pass and the number of visible clusters it works through
+struct ClusterDispatch{
+    uint x;
+    uint y;
+    uint z;
+    uint visibleCount;
+};
+
+// image holds three int16, x and y in the first word, z in the low half of the second
+struct Bond{
+    uint atom1;
+    uint atom2;
+    uint imageXY;
+    uint imageZ;
+};
+
+struct ExpandData{
+    mat4 unitCell;
+    vec4 antiStutterOffset;
+    vec4 catalystColor;
+    vec4 chemicalColor;
+    vec4 elements[256]; // rgb color, w atom radius
+    uint atomCount; // atoms per frame
+    uint shownAtomCount; // atomCount or 0 if atoms are hidden
+    uint bondCount;
+    uint firstAtomObject;
+    uint firstBondObject;
+    float atomSize;
+    float bondLength;
+    float bondThickness;
+    float atomMeshRadius;
+    float bondMeshRadius;
+    bool colorByBaseType;
+    uint positionOffset; // first float of the frame in the position buffer
+};
 
 
 #endif
\ No newline at end of file
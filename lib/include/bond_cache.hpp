@@ -0,0 +1,59 @@
+#pragma once
+
+#include "visualization_data.hpp"
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <tbb/task_arena.h>
+
+namespace rcc {
+
+// bounded LRU cache of per-frame bond lists, frames are created on demand or prefetched by background tasks
+class BondFrameCache {
+ public:
+  using FrameBondBuilder = std::function<void(uint32_t frameIndex, std::vector<Bond> &frameBonds)>;
+
+  BondFrameCache(FrameBondBuilder builder, uint32_t frameCount, size_t capacity);
+  ~BondFrameCache();
+  BondFrameCache(const BondFrameCache &) = delete;
+  BondFrameCache &operator=(const BondFrameCache &) = delete;
+
+  // blocks until the bonds of the frame are created, the reference stays valid until the next call of get or prefetch
+  // for another frame
+  const std::vector<Bond> &get(uint32_t frameIndex);
+  // schedules the frames frameIndex + direction * [1, window] (wrapping around) in the background
+  void prefetch(uint32_t frameIndex, int direction, uint32_t window);
+
+  [[nodiscard]] size_t size() const;
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+
+ private:
+  struct Entry {
+    std::shared_future<void> ready;
+    std::vector<Bond> bonds;
+    uint64_t lastUsed = 0;
+  };
+
+  // both expect mutex_ to be locked
+  Entry &request(uint32_t frameIndex);
+  void evict();
+
+  FrameBondBuilder builder_;
+  uint32_t frameCount_;
+  size_t capacity_;
+  uint64_t useCounter_ = 0;
+  uint32_t lastRequestedFrame_ = 0;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, std::unique_ptr<Entry>> entries_;
+
+  // the frames are built in their own arena, scrubbing through a long trajectory queues many of them and they
+  // must not take every core from the renderer
+  tbb::task_arena arena_;
+};
+
+} // namespace rcc
@@ -1,10 +1,14 @@
 #pragma once
 
 #include "vulkan_types.hpp"
+#include "slot_array.hpp"
+#include "linear_allocators.hpp"
 
-#include <unordered_map>
+#include <cstdlib>
+#include <deque>
 #include <vector>
 #include <functional>
+#include <mutex>
 
 namespace rcc {
 
@@ -21,9 +25,16 @@ class Buffer{
     VmaAllocation allocation_{};
     void *mapped_data_ = nullptr; // always null if buffer not mapped
 
+    // arenas hand out aligned ranges of the buffer from front to back, see ResourceManager::allocateFromArena
+    vk::DeviceSize arena_head_ = 0;
+    vk::DeviceSize arena_alignment_ = 0; // 0 if the buffer is no arena
+
     friend class ResourceManager;
 };
 
+// value the transfer timeline semaphore reaches once an upload is done, 0 is always complete
+using UploadToken = uint64_t;
+
 // points to the underlying buffer and specifies the offset and descriptor type
 class BufferResource{
   public:
@@ -39,8 +50,10 @@ class ResourceManager {
     ResourceManager(vk::Device& device, VmaAllocator& allocator);
     ~ResourceManager();
 
-    Buffer& getBuffer(uint32_t buffer_handle);
-    Buffer& getBuffer(BufferResource buffer_resource);
+    // handles index a slot array, handles of destroyed buffers abort. the reference stays valid until the
+    // buffer is destroyed
+    Buffer& getBuffer(uint32_t buffer_handle) { return buffers_[buffer_handle]; }
+    Buffer& getBuffer(const BufferResource &buffer_resource) { return getBuffer(buffer_resource.handle_); }
 
 
     // create a buffer and return a handle to it
@@ -48,18 +61,37 @@ class ResourceManager {
     [[nodiscard]] uint32_t createBuffer(size_t size, vk::BufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage,
                           vk::SharingMode sharing_mode, const std::vector<uint32_t>& queue_family_indices);
 
-    std::pair<BufferResource, BufferResource> uploadMesh(class Mesh &mesh,
-                                                         UploadContext upload_context_,
-                                                         vk::Queue upload_queue_);
-
-    void stageBuffer(void *src, vk::DeviceSize size, BufferResource dest_resource, UploadContext& upload_context, vk::Queue& upload_queue);
+    // one allocation that backs many small resources, they live until the arena is destroyed
+    [[nodiscard]] uint32_t createArena(vk::DeviceSize size, vk::DeviceSize alignment, vk::BufferUsageFlags buffer_usage,
+                                       VmaMemoryUsage memory_usage);
+    // the next aligned range of the arena, the resource shares the handle of the arena
+    [[nodiscard]] BufferResource allocateFromArena(uint32_t arena_handle, vk::DeviceSize size,
+                                                   vk::DescriptorType descriptor_type);
+
+    std::pair<BufferResource, BufferResource> uploadMesh(class Mesh &mesh);
+
+    // uploads are copied into a persistent staging ring and run on the transfer queue. without a dedicated
+    // transfer queue family the graphics queue is passed in
+    void initTransfer(vk::Queue transfer_queue, uint32_t transfer_queue_family, uint32_t graphics_queue_family,
+                      vk::DeviceSize staging_size);
+    // copies src into the staging ring and records the copy, it is submitted with the next flushUploads
+    UploadToken stageBufferAsync(const void *src, vk::DeviceSize size, BufferResource dest_resource);
+    // submits all recorded copies in one command buffer, returns the token of the last submitted upload
+    UploadToken flushUploads();
+    [[nodiscard]] bool isUploadComplete(UploadToken token);
+    void waitForUpload(UploadToken token);
+    // every graphics submit waits on the semaphore for the last submitted upload
+    [[nodiscard]] vk::Semaphore transferSemaphore() const { return transfer_semaphore_; }
+    [[nodiscard]] UploadToken lastSubmittedUpload() const { return next_token_ - 1; }
+    // blocks until the copy is done
+    void stageBuffer(const void *src, vk::DeviceSize size, BufferResource dest_resource);
     void immediateSubmit(UploadContext& upload_context, vk::Queue& upload_queue, std::function<void(vk::CommandBuffer cmd)> &&function);
 
     void writeToBuffer(BufferResource buffer_resource, const void* data, vk::DeviceSize size);
     void clearBuffer(BufferResource buffer_resource);
 
+    // frees the buffer and its slot, the handle is invalid afterwards
     void destroyBuffer(uint32_t buffer_handle);
-    void destroyBuffer(Buffer& buffer);
 
     // create a buffer resource from a buffer handle
     [[nodiscard]] BufferResource createBufferResource(uint32_t buffer_handle, vk::DeviceSize offset, vk::DeviceSize range, vk::DescriptorType descriptor_type);
@@ -74,12 +106,57 @@ class ResourceManager {
     void unmapBuffer(Buffer& buffer);
     void unmapBuffer(uint32_t buffer_handle);
 
-    std::unordered_map<uint32_t, Buffer> buffers_;
   private:
     vk::Device& device_;
     VmaAllocator& allocator_;
-    static uint32_t next_handle_;
 
+    SlotArray<Buffer> buffers_;
+    void destroyBuffer(Buffer& buffer);
+
+    // a command buffer of copies, its staging memory is free again once the timeline reached the token
+    struct UploadBatch {
+      vk::CommandBuffer cmd{};
+      UploadToken token = 0;
+      vk::DeviceSize staging_bytes = 0;
+    };
+    // the caller holds transfer_mutex_
+    vk::DeviceSize allocateStaging(vk::DeviceSize size);
+    void submitRecording();
+    void retireUploads();
+
+    vk::Queue transfer_queue_{};
+    uint32_t transfer_queue_family_ = 0;
+    uint32_t graphics_queue_family_ = 0;
+    vk::CommandPool transfer_command_pool_{};
+    vk::Semaphore transfer_semaphore_{}; // timeline, counts the submitted batches
+    uint32_t staging_handle_ = 0;
+    char *staging_data_ = nullptr;
+    StagingRing staging_ring_;
+    UploadBatch recording_{}; // no command buffer while nothing is recorded
+    std::deque<UploadBatch> in_flight_;
+    std::vector<vk::CommandBuffer> free_command_buffers_;
+    UploadToken next_token_ = 1;
+    std::mutex transfer_mutex_;
+
+};
+
+// a persistently mapped buffer with one region per frame in flight. the data the cpu writes every frame is
+// bump allocated from the region of that frame and bound with dynamic offsets, so a frame never overwrites
+// what an older frame in flight still reads
+class TransientAllocator {
+  public:
+    void init(ResourceManager &resource_manager, uint32_t frame_count, vk::DeviceSize frame_size,
+              vk::DeviceSize alignment, vk::BufferUsageFlags buffer_usage);
+    // starts the region of the frame over, its fence guarantees the gpu is done with the old slices
+    void beginFrame(uint32_t frame_index);
+    // copies the data into the next aligned slice and returns the offset of the slice in the buffer
+    uint32_t push(const void *data, vk::DeviceSize size);
+    [[nodiscard]] uint32_t handle() const { return handle_; }
+
+  private:
+    uint32_t handle_ = 0;
+    char *mapped_data_ = nullptr;
+    FrameSlices slices_;
 };
 
 } // namespace rcc
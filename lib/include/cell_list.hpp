@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Eigen/Dense"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace rcc {
+
+// linked-cell spatial binning for the bond search
+// the cell is divided into bins whose perpendicular width is at least the cutoff distance, so every pair within the
+// cutoff (for the image picked by rint on the fractional displacement) lies in the same or an adjacent bin.
+// works for orthorhombic and triclinic cells, non-periodic directions are binned over the extent of the atoms
+class CellList {
+ public:
+  // cell: columns are the lattice vectors, periodic: != 0 for every periodic direction
+  CellList(const Eigen::Matrix3f &cell, const Eigen::Array3f &periodic, float cutOffDistance);
+
+  void build(const Eigen::Ref<const Eigen::MatrixX3f> &positions);
+
+  // calls func(k) for every atom k > atomIndex in the bins around atomIndex, in ascending order of k
+  template<typename Func>
+  void forEachCandidate(uint32_t atomIndex, std::vector<uint32_t> &scratch, Func &&func) const {
+    scratch.clear();
+    const uint32_t bin = atomBins_[atomIndex];
+    for (uint32_t n = neighborStart_[bin]; n < neighborStart_[bin + 1]; n++) {
+      const uint32_t neighborBin = neighborBins_[n];
+      for (uint32_t a = binStart_[neighborBin]; a < binStart_[neighborBin + 1]; a++) {
+        if (binAtoms_[a] > atomIndex) scratch.push_back(binAtoms_[a]);
+      }
+    }
+    std::sort(scratch.begin(), scratch.end());
+    for (uint32_t k : scratch) func(k);
+  }
+
+  [[nodiscard]] bool isValid() const { return valid_; }
+  [[nodiscard]] uint32_t binCount() const { return binCount_[0]*binCount_[1]*binCount_[2]; }
+
+ private:
+  void buildNeighborBins();
+
+  Eigen::Matrix3f cell_;
+  Eigen::Matrix3f inverseCell_;
+  Eigen::Array3f periodic_;
+  Eigen::Array3f perpendicularWidths_;
+  float cutOffDistance_;
+  bool valid_ = true;
+
+  Eigen::Array3i binCount_{1, 1, 1};
+  Eigen::Array3f fractionalMin_{0.f, 0.f, 0.f};
+  Eigen::Array3f fractionalExtent_{1.f, 1.f, 1.f};
+
+  // compressed bin -> atoms and bin -> neighbor bins tables
+  std::vector<uint32_t> atomBins_;
+  std::vector<uint32_t> binStart_;
+  std::vector<uint32_t> binAtoms_;
+  std::vector<uint32_t> neighborStart_;
+  std::vector<uint32_t> neighborBins_;
+};
+
+} // namespace rcc
@@ -10,11 +10,13 @@
 
 //lib
 #include "json.hpp"
+#include <tbb/task_group.h>
 
 //stdlib
 #include <stack>
 #include <functional>
 #include <chrono>
+#include <optional>
 
 namespace rcc {
 
@@ -32,8 +34,26 @@ enum uiMode {
   eMeasure
 };
 
+// culling passes, same values as RCC_CULL_* in constants.vert
+enum CullPhase : uint32_t {
+  eCullSinglePass,
+  eCullEarly, // objects visible last frame, drawn before the depth pyramid is built
+  eCullLate   // everything else, tested against the depth pyramid
+};
+
+// pipelines draw commands are sorted into, every group is drawn with one call
+enum DrawGroup : uint32_t {
+  eDrawGroupMesh,          // atom pipeline, all meshes but the bond
+  eDrawGroupBond,          // bond pipeline
+  eDrawGroupAtomImpostor,
+  eDrawGroupBondImpostor
+};
+
 constexpr uint32_t FRAMES_IN_FLIGHT = 3;
-constexpr int MAX_UNIQUE_OBJECTS = 15000;
+// smallest capacity of the per frame object buffers, they grow with the loaded experiment
+constexpr uint32_t MIN_OBJECT_CAPACITY = 1024;
+// bytes of the resident trajectory staged per frame, every frame submit waits for the copies staged before it
+constexpr uint64_t TRAJECTORY_UPLOAD_PER_FRAME = 8*1024*1024;
 
 struct DeletionStack {
   std::stack<std::function<void()>> delete_calls;
@@ -73,9 +93,26 @@ class Engine {
 
   // buffers
   FrameData frame_data_[FRAMES_IN_FLIGHT];
-  BufferResource scene_data_buffer_;
-  BufferResource indirect_dispatch_buffer_{};
+  // camera, scene, cull data, offsets and the cluster dispatch, rewritten every frame
+  TransientAllocator transient_allocator_;
   BufferResource clear_draw_call_buffer_{};
+  // the small fixed size buffers of every frame are ranges of these, host visible and device local
+  uint32_t host_arena_ = 0;
+  uint32_t device_arena_ = 0;
+
+  // number of objects, atoms and bonds the per frame buffers can hold
+  struct ObjectCapacity {
+    uint32_t objects = MIN_OBJECT_CAPACITY;
+    uint32_t atoms = MIN_OBJECT_CAPACITY;
+    uint32_t bonds = MIN_OBJECT_CAPACITY;
+    // final instances: every object once per periodic image and detail level range, see GPUDrawCalls.
+    // only atoms and bonds have more than one range
+    uint32_t finalInstances() const { return 27*(objects + (RCC_LOD_COUNT/2 - 1)*(atoms + bonds)); }
+  } object_capacity_;
+  void createObjectBuffers(FrameData &frame, const ObjectCapacity &capacity);
+  void destroyObjectBuffers(FrameData &frame);
+  void buildDescriptorSets(FrameData &frame);
+  void reserveObjectBuffers(bool allow_shrink);
 
   // descriptors
   DescriptorLayoutCache layout_cache_;
@@ -84,16 +121,72 @@ class Engine {
   // graphics pipelines and descriptor sets
   vk::PipelineLayout graphics_pipeline_layout_;
   std::unique_ptr<class Pipeline> atom_pipeline_, bond_pipeline_, atom_pipeline_iso_, bond_pipeline_iso_;
+  // atoms as ray cast spheres on quads and bonds as ray cast cylinders in boxes instead of the sphere and bond meshes.
+  // the draw commands of the clear draw call buffer use the proxy geometry while they are enabled. the pipelines
+  // are created when the impostors are turned on for the first time
+  bool impostor_rendering_ = false;
+  std::unique_ptr<class Pipeline> atom_impostor_pipeline_, bond_impostor_pipeline_;
+  std::unique_ptr<class Pipeline> atom_impostor_pipeline_iso_, bond_impostor_pipeline_iso_;
   vk::DescriptorSetLayout graphics_descriptor_set_layout;
   SpecializationConstants specialization_constants_{};
 
+  // what the clear draw call buffer was written for, it is written again when this changes
+  struct DrawCallLayout {
+    bool impostors = false;
+    std::array<uint32_t, RCC_MESH_COUNT> max_counts{};
+    bool operator==(const DrawCallLayout &) const = default;
+  };
+  DrawCallLayout currentDrawCallLayout() const;
+  DrawCallLayout written_draw_call_layout_;
+  // DrawGroup of every draw command, the groups are drawn one after another
+  std::array<DrawGroup, RCC_MESH_COUNT*RCC_LOD_COUNT> draw_groups_{};
+  // without drawIndirectCount (vulkan 1.2) every command of a group is drawn, empty ones draw nothing
+  bool draw_indirect_count_supported_ = false;
+  // the culling shader picks the coarsest level of detail whose error stays below this many pixels
+  float lod_error_threshold_ = 1.f;
+
   // compute pipeline and descriptor set
+  // clusters of objects are culled first, the objects of visible clusters afterwards. both share one layout
+  vk::Pipeline cluster_culling_compute_pipeline_;
   vk::Pipeline culling_compute_pipeline_;
+  vk::Pipeline compact_draws_compute_pipeline_; // same layout, only used with drawIndirectCount
   vk::PipelineLayout culling_compute_pipeline_layout_;
   vk::DescriptorSetLayout culling_descriptor_set_layout;
+  // occlusion culling: what was visible last frame is drawn first, its depth is reduced into the depth pyramid
+  // of the swapchain and the remaining objects are tested against that pyramid
+  bool occlusion_culling_enabled_ = true;
+  BufferResource visibility_buffer_{}; // shared by all frames, they run one after another on the gpu
+  bool visibility_cleared_ = false;
+  vk::Pipeline depth_reduce_compute_pipeline_;
+  vk::PipelineLayout depth_reduce_pipeline_layout_;
+  vk::DescriptorSetLayout depth_reduce_descriptor_set_layout, depth_pyramid_descriptor_set_layout;
+  DescriptorAllocator depth_pyramid_descriptor_allocator_; // reset when the swapchain is recreated
+  std::vector<vk::DescriptorSet> depth_reduce_sets_;
+  vk::DescriptorSet depth_pyramid_set_;
+  void createVisibilityBuffer(const ObjectCapacity &capacity);
+  void buildDepthPyramidDescriptorSets();
+  void buildDepthPyramid(vk::CommandBuffer cmd);
+  bool isOcclusionCullingActive() const;
+  // positions only upload path: only positions, tags and bonds are uploaded and expanded into objects on the gpu
+  bool gpu_object_expansion_ = false;
+  vk::Pipeline expand_compute_pipeline_;
+  vk::PipelineLayout expand_compute_pipeline_layout_;
+  vk::DescriptorSetLayout expand_descriptor_set_layout;
+  // all frames in one device local buffer, the expand shader picks the frame, nothing is uploaded per frame
+  bool gpu_resident_trajectory_ = false;
+  bool trajectory_uploaded_ = false;
+  bool trajectory_checked_ = false; // uploaded or found too large for the current experiment
+  BufferResource trajectory_buffer_{};
+  bool trajectory_upload_pending_ = false; // copied on the transfer queue, bound once the last piece completed
+  vk::DeviceSize trajectory_upload_cursor_ = 0; // bytes of the trajectory staged so far
+  UploadToken trajectory_upload_token_ = 0; // of the last staged piece
+  void uploadTrajectory();
+  void finishTrajectoryUpload();
+  void releaseTrajectory();
+  void bindExpandPositions(bool resident);
   vk::Pipeline createComputePipeline(const std::string &shader_path, const vk::PipelineLayout &compute_pipeline_layout);
 
-  // transfers
+  // transfers, immediate submits on the graphics queue. buffer uploads go through the ResourceManager
   UploadContext upload_context_;
 
   // rendering
@@ -106,9 +199,19 @@ class Engine {
   void loadMeshes();
 
   // rendering
-  void draw(vk::CommandBuffer &cmd);
-  void beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index);
-  void runCullComputeShader(vk::CommandBuffer cmd);
+  void draw(vk::CommandBuffer &cmd, const BufferResource &draw_calls);
+  void beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index, vk::RenderPass render_pass);
+  void setViewportAndScissor(vk::CommandBuffer &cmd);
+  // frame graph lite: every pass of a frame is recorded into its own secondary command buffer on a worker thread,
+  // passes without a render pass run between the render passes
+  struct FramePass {
+    vk::RenderPass render_pass{};
+    std::function<void(vk::CommandBuffer)> record;
+  };
+  void recordFramePasses(vk::CommandBuffer &cmd, uint32_t swapchain_index, const std::vector<FramePass> &passes);
+  vk::CommandBuffer beginSecondaryCommandBuffer(const vk::CommandBufferInheritanceInfo &inheritance);
+  void runCullComputeShader(vk::CommandBuffer cmd, CullPhase phase);
+  void runExpandComputeShader(vk::CommandBuffer cmd);
 
   // scene
   std::array<float, 4> clearColor{0.f, 0.f, 0.f, 0.f};
@@ -117,6 +220,7 @@ class Engine {
   // viewing state control
   void toggleFrameControlMode() { framerate_control_.manualFrameControl = !framerate_control_.manualFrameControl; }
   void toggleCameraMode();
+  void updateCamera();
 
   //Getters
   int GetMovieFrameIndex() const { return static_cast<int>(framerate_control_.movie_frame_index_); }
@@ -139,6 +243,47 @@ class Engine {
   int max_cell_count_;
   bool isCullingEnabled = true;
 
+  // what the buffers of a frame were written from, a frame in flight whose buffers were written from an equal
+  // state does not write them again
+  struct ObjectState {
+    int experiment_id = -1;
+    uint32_t movie_frame = 0;
+    uint64_t tags_version = 0;
+    uint64_t settings_version = 0;
+    int selected_object = -1;
+    bool bonds_loaded = false;
+    bool trajectory_uploaded = false;
+    bool operator==(const ObjectState &) const = default;
+  };
+  struct ViewState {
+    glm::mat4 view{1.f};
+    glm::mat4 projection{1.f};
+    bool culling_enabled = true;
+    bool occlusion_culling_enabled = true;
+    bool impostor_rendering = false;
+    bool operator==(const ViewState &) const = default;
+  };
+  struct RenderState {
+    ObjectState objects;
+    ViewState view;
+    bool operator==(const RenderState &) const = default;
+  };
+  RenderState currentRenderState() const;
+  std::optional<RenderState> written_render_states_[FRAMES_IN_FLIGHT];
+  // writes the object and instance buffers of the current frame on a worker while the main thread acquires
+  // the image, records and waits for the frame rate limit. joined before the frame is submitted
+  tbb::task_group frame_preparation_;
+
+  // without changes and input the same image would be rendered again, the loop waits for input instead
+  struct {
+    bool enabled = true;
+    uint32_t unchanged_frames = 0; // frames in a row whose buffers did not change
+    uint64_t input_events = 0, seen_input_events = 0;
+    double cursor_x = 0., cursor_y = 0.;
+    int width = 0, height = 0;
+  } idle_;
+  bool waitForInputIfIdle();
+
   // camera
   std::unique_ptr<Camera> camera_;
   bool bDragRotateCam_ = false;
@@ -159,11 +304,14 @@ class Engine {
     int movie_framerate_ = 200;
     int frame_number_{0};
     float movie_frame_index_{0};
+    uint32_t last_movie_frame_{0};
+    int movie_direction_{1};
   } framerate_control_;
 
   // control flow vars
   State experiment_state_ = eNone;
   State database_state = eNone;
+  bool experiment_pending_ = false; // loading in the background, not shown yet
 
   // file management
   std::string db_filepath_;
@@ -182,6 +330,8 @@ class Engine {
   VmaAllocator allocator_{};
   uint32_t graphics_queue_family_{};
   vk::Queue graphics_queue_;
+  uint32_t transfer_queue_family_{}; // the graphics queue family without a dedicated transfer family
+  vk::Queue transfer_queue_;
 
   // rcc vulkan wrapper
   std::unique_ptr<class Swapchain> swapchain_;
@@ -196,6 +346,7 @@ class Engine {
   void initSyncStructures();
   void initDescriptors();
   void initPipelines();
+  void initImpostorPipelines();
   void initComputePipelines();
   void initScene();
   void initCamera();
@@ -205,10 +356,12 @@ class Engine {
     BufferResource createBuffer(size_t allocSize, vk::BufferUsageFlags usage, VmaMemoryUsage memory_usage) const;
     size_t paddedUniformBufferSize(size_t old_size) const;
     void writeClearDrawCallBuffer();
+    void writeTransientData();
     void writeIndirectDispatchBuffer();
     void writeCameraBuffer();
     void writeSceneBuffer();
     void writeObjectAndInstanceBuffer();
+    void writeExpandBuffers();
     void writeCullBuffer();
     void writeOffsetBuffer();
     void resetDrawData(vk::CommandBuffer &cmd,
@@ -218,6 +371,8 @@ class Engine {
 
     GPUOffsets getOffsets();
     void loadExperiment(int experiment_id);
+    void showLoadedExperiment();
+    void prefetchMovieFrames();
     void unloadExperiment();
     void connectToDB();
     void disconnectFromDB();
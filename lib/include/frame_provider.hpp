@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Eigen/Dense"
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rcc {
+
+// positions of all frames, frame f is a block of atomCount x 3 floats (column major like Eigen::MatrixX3f).
+// the blocks either live in memory or in a memory mapped file, in which case only the pages around the displayed
+// frame are kept resident (see prefetch).
+class FrameProvider {
+ public:
+  using Frame = Eigen::Map<const Eigen::MatrixX3f>;
+  using MutableFrame = Eigen::Map<Eigen::MatrixX3f>;
+
+  FrameProvider() = default;
+  ~FrameProvider();
+  FrameProvider(const FrameProvider &) = delete;
+  FrameProvider &operator=(const FrameProvider &) = delete;
+
+  // writable storage, if backingFilepath is given the frames are backed by that file instead of anonymous memory,
+  // the file is removed right away and only lives as long as the mapping
+  void allocate(uint32_t frameCount, uint32_t atomCount, const std::string &backingFilepath = "");
+  // read only view of frame blocks starting at offset bytes into the file
+  bool map(const std::string &filepath, uint64_t offset, uint32_t frameCount, uint32_t atomCount);
+  void clear();
+
+  Frame operator[](size_t frameIndex) const {
+    return Frame(data_ + frameIndex*frameStride(), atomCount_, 3);
+  }
+  MutableFrame frame(size_t frameIndex) {
+    assert(isWritable_ && "FrameProvider::frame: frames are mapped read only");
+    return MutableFrame(data_ + frameIndex*frameStride(), atomCount_, 3);
+  }
+
+  // asks the kernel to read the frames ahead in playback direction and releases the frames that left the window
+  void prefetch(uint32_t frameIndex, int direction, uint32_t window) const;
+
+  [[nodiscard]] size_t size() const { return frameCount_; }
+  [[nodiscard]] bool empty() const { return frameCount_==0; }
+  [[nodiscard]] uint32_t atomCount() const { return atomCount_; }
+  [[nodiscard]] bool isMapped() const { return mapping_!=nullptr; }
+  [[nodiscard]] size_t frameStride() const { return size_t{atomCount_}*3; }
+  [[nodiscard]] const float *data() const { return data_; }
+  [[nodiscard]] float *data() {
+    assert(isWritable_ && "FrameProvider::data: frames are mapped read only");
+    return data_;
+  }
+
+ private:
+  void adviseFrames(uint32_t first, uint32_t last, int advice) const;
+
+  std::vector<float> memory_;
+  float *data_ = nullptr;
+  void *mapping_ = nullptr;
+  size_t mappingSize_ = 0;
+  bool isWritable_ = false;
+  uint32_t frameCount_ = 0;
+  uint32_t atomCount_ = 0;
+
+  // frames [residentBegin_, residentEnd_) were prefetched last time
+  mutable uint32_t residentBegin_ = 0;
+  mutable uint32_t residentEnd_ = 0;
+};
+
+} // namespace rcc
@@ -67,6 +67,7 @@ class UserInterface {
   // widgets
   void showSettingTable(int settingID);
   void showEventsTable(int experimentID);
+  void showLoadProgress();
   static bool showSelectionRectangle(ImVec2 &start_pos, ImVec2 &end_pos);
 
   friend class Engine;
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+
+namespace rcc {
+
+// offsets of the copies in the staging ring of the ResourceManager. a copy that doesn't fit behind the head starts
+// at the front, the bytes skipped at the end are charged to it. copies are released in the order they were allocated
+class StagingRing {
+ public:
+  static constexpr uint64_t ALIGNMENT = 16;
+  struct Allocation {
+    uint64_t offset = 0;
+    uint64_t charged = 0; // size of the copy, including the bytes skipped at the end when the ring wrapped
+  };
+
+  void init(uint64_t size) {
+    size_ = size;
+    head_ = 0;
+    used_ = 0;
+  }
+
+  // empty while the ring is too full, older copies have to be released first
+  [[nodiscard]] std::optional<Allocation> allocate(uint64_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    assert(size <= size_);
+    // an empty ring starts over at the front, so large copies don't have to wrap
+    if (used_==0) head_ = 0;
+    const bool wraps = head_ + size > size_;
+    const uint64_t charged = size + (wraps ? size_ - head_ : 0);
+    if (used_ + charged > size_) return std::nullopt;
+    const uint64_t offset = wraps ? 0 : head_;
+    head_ = offset + size;
+    used_ += charged;
+    return Allocation{offset, charged};
+  }
+
+  void release(uint64_t charged) {
+    assert(charged <= used_);
+    used_ -= charged;
+  }
+
+  [[nodiscard]] uint64_t size() const { return size_; }
+  [[nodiscard]] uint64_t used() const { return used_; }
+
+ private:
+  uint64_t size_ = 0;
+  uint64_t head_ = 0;
+  uint64_t used_ = 0;
+};
+
+// one region per frame in flight, the slices of a frame are handed out front to back and aligned. a region is
+// started over when its frame begins again, the fence of the frame guarantees the gpu is done with the old slices
+class FrameSlices {
+ public:
+  // returns the size of all regions together
+  uint64_t init(uint32_t frame_count, uint64_t frame_size, uint64_t alignment) {
+    alignment_ = alignment < 4 ? 4 : alignment;
+    frame_size_ = alignUp(frame_size);
+    return frame_count*frame_size_;
+  }
+
+  void beginFrame(uint32_t frame_index) {
+    frame_begin_ = frame_index*frame_size_;
+    head_ = frame_begin_;
+  }
+
+  // offset of the slice from the beginning of the first region
+  [[nodiscard]] uint64_t allocate(uint64_t size) {
+    const uint64_t offset = head_;
+    assert(offset + size <= frame_begin_ + frame_size_);
+    head_ = alignUp(offset + size);
+    return offset;
+  }
+
+  [[nodiscard]] uint64_t frameSize() const { return frame_size_; }
+  [[nodiscard]] uint64_t alignment() const { return alignment_; }
+
+ private:
+  [[nodiscard]] uint64_t alignUp(uint64_t value) const { return (value + alignment_ - 1)/alignment_*alignment_; }
+
+  uint64_t frame_size_ = 0;
+  uint64_t alignment_ = 4;
+  uint64_t frame_begin_ = 0;
+  uint64_t head_ = 0;
+};
+
+} // namespace rcc
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rcc {
+
+// where the culling shader writes the instances of a detail level in the final instance buffer. two consecutive
+// levels share one range with room for every instance of the mesh: the even level fills it from the front, the
+// odd one from the back, so firstInstance of an odd level starts at the end of the range
+struct LodInstanceRange {
+  uint32_t firstInstance = 0;
+  uint32_t rangeEnd = 0;
+};
+
+// assigns the ranges of levelCount levels of one mesh behind firstFreeInstance, returns the first instance after them
+inline uint32_t assignLodInstanceRanges(uint32_t firstFreeInstance, const uint32_t rangeSize, const uint32_t levelCount,
+                                        LodInstanceRange *ranges) {
+  for (uint32_t lod = 0; lod < levelCount; lod++) {
+    if (lod%2==0) firstFreeInstance += rangeSize;
+    ranges[lod].firstInstance = (lod%2==0) ? firstFreeInstance - rangeSize : firstFreeInstance;
+    ranges[lod].rangeEnd = firstFreeInstance;
+  }
+  return firstFreeInstance;
+}
+
+} // namespace rcc
@@ -21,7 +21,10 @@ enum meshID {
     eUnitCell = 1,
     eVector = 2,
     eCylinder = 3,
-    eBond = 4
+    eBond = 4,
+    // proxy geometry of the impostor pipelines, not an object type of the scene
+    eImpostorQuad = 5,
+    eImpostorBox = 6
 };
 
 struct VertexDescription {
@@ -54,10 +57,18 @@ struct MeshInterface {
   virtual uint32_t getIndicesCount() = 0;
 };
 
+// a range of the index buffer that draws the mesh with fewer triangles, all levels share the vertices
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error; // largest deviation from the full mesh, relative to the mesh radius
+};
+
 //template<typename VertexType>
 struct Mesh : public MeshInterface {
   std::vector<BasicVertex> vertices_;
   std::vector<uint32_t> indices_;
+  std::vector<MeshLod> lods_; // empty or starting with the full mesh
 
   float radius;
 
@@ -65,6 +76,9 @@ struct Mesh : public MeshInterface {
   uint32_t getIndicesCount() override { return indices_.size(); };
 
   void optimizeMesh();
+  // appends simplified index lists with a quarter of the triangles of the previous level each,
+  // levels that can't be simplified further repeat the last one. needs the radius
+  void generateLods(uint32_t lod_count);
 
   void calcRadius();
 
@@ -72,6 +86,9 @@ struct Mesh : public MeshInterface {
   void createUnitCellMesh(const glm::mat3 &b);
   //void createFrustumMesh();
   void createBeam(const glm::vec3 p1, glm::vec3 p2, glm::vec3 right_dir, glm::vec3 up_dir, float thickness);
+  // corners in [-1, 1], the impostor shaders scale and place them per object
+  void createImpostorQuad();
+  void createImpostorBox();
 };
 
 class MeshMerger {
@@ -83,6 +100,7 @@ class MeshMerger {
     uint32_t indexCount;
     int32_t firstVertex;
     float radius;
+    std::vector<MeshLod> lods; // index ranges already offset into the merged mesh
   };
 
   std::map<meshID, MeshInfo> meshInfos;
@@ -8,6 +8,7 @@
 #include "mesh.hpp"
 #include "utils.hpp"
 #include "visualization_data_loader.hpp"
+#include <array>
 #include <cstdint>
 #include <utility>
 
@@ -121,25 +122,33 @@ class Scene {
     int zCellCount;
     glm::vec4 catalyst_color_;
     glm::vec4 chemical_color_;
+    bool operator==(const VisualizationConfig &) const = default;
   } gConfig{};
 
   ObjectType *objectTypes[RCC_MESH_COUNT]{};
   void setMeshes(MeshMerger *mesh_merger) { meshes = mesh_merger; };
 
-  [[nodiscard]] uint32_t MovieFrameCount() const { return visManager->data().positions.size(); }
+  // frames that can be shown, less than the trajectory has while it is loaded in the background
+  [[nodiscard]] uint32_t MovieFrameCount() const { return visManager->loadedFrameCount(); }
   [[nodiscard]] std::string getObjectInfo(uint32_t movieFrameIndex, uint32_t objectIndex) const;
   [[nodiscard]] uint32_t uniqueShownObjectCount(uint32_t movieFrameIndex) const;
   [[nodiscard]] const glm::mat3 &cellGLM() const { return visManager->data().unitCellGLM; }
   [[nodiscard]] const Eigen::Matrix<float, 3, 3> &cellEigen() const { return visManager->data().unitCellEigen; }
   [[nodiscard]] int freezeAtom() const { return freezeAtomIndex; }
   [[nodiscard]] int tryPickFreezeAtom() const; // returns -1 if not successful
-  [[nodiscard]] inline glm::vec3 antiStutterOffset(uint32_t movieFrameIndex) const;
+  [[nodiscard]] glm::vec3 antiStutterOffset(uint32_t movieFrameIndex) const;
+  // changes whenever a setting the object buffer depends on changed: gConfig, shown types, color mode,
+  // event viewer settings, active event or freeze atom. the gui edits these directly, so they are compared
+  [[nodiscard]] uint64_t settingsVersion() const;
 
   void pickFreezeAtom(const int atomIndex) { freezeAtomIndex = atomIndex; }
+  // with skipExpandedTypes atoms and bonds are left out, the expand compute shader writes them
   void writeObjectAndInstanceBuffer(GPUObjectData *objectData,
                                     GPUInstance *instanceData,
                                     uint32_t movieFrameIndex,
-                                    uint32_t selectedObjectIndex) const;
+                                    uint32_t selectedObjectIndex,
+                                    bool skipExpandedTypes = false) const;
+  void writeExpandData(GPUExpandData &expandData, uint32_t movieFrameIndex) const;
 
   ObjectType &operator[](const std::string &identifier) const {
     for (auto type : objectTypes) {
@@ -161,14 +170,43 @@ class Scene {
  private:
   int freezeAtomIndex = -1;
 
+  // radius and color per element number (tag & 255), so the buffer writers don't search elementInfos per object
+  struct ElementTable {
+    std::array<float, 256> radius{};
+    std::array<glm::vec4, 256> color{};
+  };
+  // rebuilt before every buffer write, elementInfos and the colors in gConfig can change between frames
+  mutable ElementTable element_table_{};
+  void updateElementTable() const;
+  // atom indices sorted along a morton curve through a grid over the atoms of a frame. atom instances are
+  // written in this order, so the clusters of consecutive instances the culling shader tests are compact
+  mutable std::vector<uint32_t> atomOrder_;
+  mutable std::vector<uint64_t> atomOrderKeys_;
+  void updateAtomOrder(uint32_t movieFrameIndex, uint32_t atomCount) const;
+  // index of the first object of every type in the object buffer, types that are not written get no range
+  [[nodiscard]] std::array<uint32_t, RCC_MESH_COUNT> firstObjectIndices(uint32_t movieFrameIndex) const;
+  [[nodiscard]] bool isWritten(meshID type) const { return objectTypes[type]->isLoaded() && objectTypes[type]->shown; }
+
   [[nodiscard]] glm::vec4 getAtomColor(uint32_t tag) const;
-  [[nodiscard]] glm::vec4 colorAtomByElementNumber(uint32_t tag) const;
-  [[nodiscard]] glm::vec4 colorAtomByBaseType(uint32_t tag) const;
-  // function pointer to atom color member function
-  glm::vec4 (Scene::*current_atom_color_function)(uint32_t tag) const = &Scene::colorAtomByElementNumber;
+  bool colorByBaseType_ = false;
+
+  struct Settings {
+    VisualizationConfig config{};
+    std::array<bool, RCC_MESH_COUNT> shown{};
+    bool colorByBaseType = false;
+    float cylinderLength = 0.f;
+    float cylinderRadius = 0.f;
+    bool enableCylinderCulling = false;
+    bool surfaceNormals = false;
+    const void *activeEvent = nullptr;
+    int freezeAtom = -1;
+    bool operator==(const Settings &) const = default;
+  };
+  mutable Settings lastSettings_{};
+  mutable uint64_t settingsVersion_ = 0;
  public:
-  void activateColorByElementNumber() { current_atom_color_function = &Scene::colorAtomByElementNumber; }
-  void activateColorByBaseType() { current_atom_color_function = &Scene::colorAtomByBaseType; }
+  void activateColorByElementNumber() { colorByBaseType_ = false; }
+  void activateColorByBaseType() { colorByBaseType_ = true; }
 
   friend AtomType;
   friend UnitCellType;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace rcc {
+
+// values addressed by 32 bit handles: the index of the slot in the lower bits and the generation of the slot in
+// the upper bits. freeing a slot bumps its generation, so handles of freed values no longer match and are caught.
+// a slot whose generation is used up is retired instead of reused, a generation is never handed out twice for
+// the same index. slots live in a deque, references stay valid while other values are inserted
+template<typename T>
+class SlotArray {
+ public:
+  static constexpr uint32_t INDEX_BITS = 20;
+  static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+  static constexpr uint32_t MAX_GENERATION = ~0u >> INDEX_BITS;
+
+  // the generation starts at 1, handle 0 is never valid
+  [[nodiscard]] uint32_t insert(T value) {
+    uint32_t index;
+    if (free_slots_.empty()) {
+      if (slots_.size() > INDEX_MASK) abort();
+      index = static_cast<uint32_t>(slots_.size());
+      slots_.emplace_back();
+    } else {
+      index = free_slots_.back();
+      free_slots_.pop_back();
+    }
+    auto &slot = slots_[index];
+    slot.value = std::move(value);
+    slot.alive = true;
+    return (slot.generation << INDEX_BITS) | index;
+  }
+
+  [[nodiscard]] bool contains(uint32_t handle) const {
+    const uint32_t index = handle & INDEX_MASK;
+    return index < slots_.size() && slots_[index].alive && slots_[index].generation==(handle >> INDEX_BITS);
+  }
+
+  // aborts on handles of freed values
+  T &operator[](uint32_t handle) {
+    if (!contains(handle)) abort();
+    return slots_[handle & INDEX_MASK].value;
+  }
+
+  void erase(uint32_t handle) {
+    if (!contains(handle)) abort();
+    const uint32_t index = handle & INDEX_MASK;
+    auto &slot = slots_[index];
+    slot.value = T{};
+    slot.alive = false;
+    if (slot.generation==MAX_GENERATION) return;
+    slot.generation++;
+    free_slots_.push_back(index);
+  }
+
+  template<typename F>
+  void forEach(F &&function) {
+    for (auto &slot : slots_) {
+      if (slot.alive) function(slot.value);
+    }
+  }
+
+ private:
+  struct Slot {
+    T value{};
+    uint32_t generation = 1;
+    bool alive = false;
+  };
+  std::deque<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+};
+
+} // namespace rcc
@@ -42,13 +42,32 @@ class Swapchain {
   vk::Result present(uint32_t swapchainIndex, vk::Semaphore renderCompleted, vk::Queue presentQueue);
 
   vk::RenderPass renderPass() { return finalRenderPass; }
+  // with occlusion culling a frame is drawn in two passes: the early pass leaves the depth image readable for the
+  // depth pyramid, the late pass draws on top of it and presents. both are compatible with renderPass()
+  vk::RenderPass earlyRenderPass() { return earlyPass; }
+  vk::RenderPass lateRenderPass() { return latePass; }
   vk::Framebuffer framebuffer(uint32_t swapchainIndex) { return framebuffers[swapchainIndex]; }
+  vk::Extent2D extent() const { return swapchainExtent; }
+
+  // depth pyramid (hi-z): every texel holds the farthest depth of the texels it covers in the level below,
+  // level 0 covers the depth image with the next smaller power of two size
+  vk::ImageView depthView() { return depthImageView; }
+  vk::Image depthPyramid() { return depthPyramidImage.image; }
+  vk::ImageView depthPyramidView() { return depthPyramidImageView; }
+  vk::ImageView depthPyramidMipView(uint32_t level) { return depthPyramidMipViews[level]; }
+  uint32_t depthPyramidLevels() const { return depthPyramidMipViews.size(); }
+  vk::Extent2D depthPyramidExtent() const { return depthPyramidSize; }
+  vk::Sampler depthPyramidSampler() { return depthSampler; }
 
  private:
   void createSwapchain();
   void createImageViews();
   void createRenderPass();
   void createDepthRecourses();
+  void createDepthPyramid();
+  vk::RenderPass createRenderPass(vk::AttachmentLoadOp loadOp,
+                                  vk::ImageLayout colorInitialLayout, vk::ImageLayout colorFinalLayout,
+                                  vk::ImageLayout depthInitialLayout, vk::ImageLayout depthFinalLayout);
   void createFramebuffers();
 
   SwapchainSupportCapabilities querySwapchainCapabilities();
@@ -61,6 +80,8 @@ class Swapchain {
 
   vk::SwapchainKHR swapchain;
   vk::RenderPass finalRenderPass;
+  vk::RenderPass earlyPass;
+  vk::RenderPass latePass;
 
   std::vector<vk::Framebuffer> framebuffers;
   vk::Format imageFormat;
@@ -72,6 +93,12 @@ class Swapchain {
   AllocatedImage depthImage;
   vk::ImageView depthImageView;
 
+  AllocatedImage depthPyramidImage;
+  vk::ImageView depthPyramidImageView;
+  std::vector<vk::ImageView> depthPyramidMipViews;
+  vk::Extent2D depthPyramidSize;
+  vk::Sampler depthSampler;
+
   vk::Extent2D swapchainExtent;
   vk::Extent2D windowExtent;
 
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "visualization_data.hpp"
+#include <cstdint>
+#include <string>
+
+namespace rcc {
+
+// binary sidecar file next to the database holding everything loaded from the systems/atoms/positions tables
+// of one experiment: unit cell, element infos, atom ids, tags and the positions as contiguous float32 frame blocks.
+// the file is stamped with the modification time and size of the database (and its write ahead log) and ignored as
+// soon as they change.
+class TrajectoryCache {
+ public:
+  static constexpr uint32_t kVersion = 2;
+
+  // fixed size header at the beginning of the file, all offsets are in bytes from the start of the file
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    int32_t experimentID;
+    int64_t dbModificationTime;
+    uint64_t dbSize;
+    uint32_t frameCount;
+    uint32_t atomCount;
+    uint32_t elementCount;
+    uint32_t padding;
+    float unitCell[9]; // column major, columns are the lattice vectors
+    float pbc[3];
+    uint64_t positionsOffset; // frameCount blocks of atomCount x 3 floats, column major like Eigen::MatrixX3f
+    uint64_t atomIDsOffset;
+    uint64_t tagsOffset;
+    uint64_t elementsOffset;
+    uint64_t fileSize;
+  };
+
+  struct Element {
+    uint32_t atomicNumber;
+    float atomRadius;
+    float color[3];
+    char symbol[8];
+  };
+
+  TrajectoryCache(const std::string &dbFilepath, int experimentID);
+
+  // fills unit cell, element infos, atom ids, tags and positions, returns false if there is no valid cache file
+  // with mapPositions the positions are not copied but mapped from the cache file
+  bool read(VisualizationData &vis, bool mapPositions = false) const;
+  bool write(const VisualizationData &vis) const;
+  // replaces the positions with the frames of the cache file written before
+  bool mapPositions(VisualizationData &vis) const;
+
+  [[nodiscard]] const std::string &filepath() const { return filepath_; }
+
+ private:
+  bool databaseStamp(int64_t &modificationTime, uint64_t &size) const;
+  // the header belongs to this experiment and database state and all its ranges lie inside the file
+  bool isCurrent(const Header &header, uint64_t fileSize) const;
+
+  std::string dbFilepath_;
+  std::string filepath_;
+  int experimentID_;
+};
+
+} // namespace rcc
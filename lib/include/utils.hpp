@@ -6,6 +6,7 @@
 
 #include <glm/glm.hpp>
 #include <deque>
+#include <vector>
 
 #ifndef RCC_POINT_LIGHT_COUNT
 #define RCC_POINT_LIGHT_COUNT 1
@@ -15,6 +16,13 @@
 #endif
 
 #define RCC_MESH_COUNT 5
+// detail levels per mesh, every level gets its own draw command
+#define RCC_LOD_COUNT 4
+// pipelines the draw commands are sorted into, see DrawGroup in engine.hpp
+#define RCC_DRAW_GROUP_COUNT 4
+
+// consecutive instances that are culled together, see cull_clusters.comp
+#define RCC_CLUSTER_SIZE 64
 
 namespace rcc {
 
@@ -37,8 +45,16 @@ struct GPUFinalInstance {
   uint32_t offset_id;
 };
 
+// the draw command of level lod of mesh m is commands[m*RCC_LOD_COUNT + lod]. two levels share one range of
+// instances, the even level fills it from the front and the odd level from lodRangeEnds backwards
 struct GPUDrawCalls {
-  vk::DrawIndexedIndirectCommand commands[RCC_MESH_COUNT];
+  vk::DrawIndexedIndirectCommand commands[RCC_MESH_COUNT*RCC_LOD_COUNT];
+  uint32_t lodRangeEnds[RCC_MESH_COUNT*RCC_LOD_COUNT];
+  glm::vec4 lodErrors[RCC_MESH_COUNT]; // error of every level relative to the object radius, infinite if missing
+  uint32_t drawGroups[RCC_MESH_COUNT*RCC_LOD_COUNT]; // DrawGroup of every command
+  // written by compact_draws.comp: the commands with instances, RCC_MESH_COUNT*RCC_LOD_COUNT slots per draw group
+  uint32_t drawCounts[RCC_DRAW_GROUP_COUNT];
+  vk::DrawIndexedIndirectCommand compactedCommands[RCC_DRAW_GROUP_COUNT*RCC_MESH_COUNT*RCC_LOD_COUNT];
 };
 
 struct GPUObjectData {
@@ -54,6 +70,7 @@ struct GPUObjectData {
 
 struct GPUCullData {
   glm::mat4 viewMatrix;
+  glm::mat4 projectionMatrix;
   glm::vec4 frustumNormalEquations[6];
   glm::vec4 cylinderCenter;
   glm::vec4 cylinderNormal;
@@ -63,6 +80,53 @@ struct GPUCullData {
   uint32_t offsetCount;
   alignas(4) bool isCullingEnabled;
   alignas(4) bool cullCylinder;
+  float lodScale; // pixels per world unit at a clip space w of 1
+  float lodErrorThreshold; // in pixels
+};
+
+// a cluster that is visible in one periodic image, its objects are culled one by one afterwards
+struct GPUVisibleCluster {
+  uint32_t clusterID;
+  uint32_t offsetID;
+};
+
+struct GPUClusterDispatch {
+  vk::DispatchIndirectCommand dispatch;
+  uint32_t visibleCount;
+};
+
+struct GPUDepthReduceConstants {
+  uint32_t outputWidth, outputHeight;
+  uint32_t inputWidth, inputHeight;
+};
+
+// same layout as Bond in visualization_data.hpp
+struct GPUBond {
+  uint32_t atom1;
+  uint32_t atom2;
+  int16_t image[3];
+  uint16_t padding;
+};
+
+// parameters of the expand_objects compute shader, which builds the atom and bond objects on the gpu
+struct GPUExpandData {
+  glm::mat4 unitCell;
+  glm::vec4 antiStutterOffset;
+  glm::vec4 catalystColor;
+  glm::vec4 chemicalColor;
+  glm::vec4 elements[256]; // rgb color, w atom radius
+  uint32_t atomCount; // atoms per frame
+  uint32_t shownAtomCount; // atomCount or 0 if atoms are hidden
+  uint32_t bondCount;
+  uint32_t firstAtomObject;
+  uint32_t firstBondObject;
+  float atomSize;
+  float bondLength;
+  float bondThickness;
+  float atomMeshRadius;
+  float bondMeshRadius;
+  alignas(4) bool colorByBaseType;
+  uint32_t positionOffset; // first float of the frame in the position buffer
 };
 
 struct GPUCamData {
@@ -80,20 +144,49 @@ struct GPUSceneData {
 };
 
 struct FrameData {
-  BufferResource cam_buffer{};
   BufferResource object_buffer{};
-  BufferResource cull_data_buffer{};
   BufferResource instance_buffer{};
   BufferResource final_instance_buffer{};
-  BufferResource offset_buffer{};
   BufferResource draw_call_buffer{};
   BufferResource mouseBucketBuffer{};
-
-  vk::DescriptorSet globalDescriptorSet, test_compute_shader_set;
+  // written by the cluster culling pass, read by the object culling pass
+  BufferResource visible_cluster_buffer{};
+  BufferResource cluster_dispatch_buffer{};
+  // draws of the late pass of occlusion culling, draw_call_buffer holds the early pass then
+  BufferResource late_draw_call_buffer{};
+
+  // positions only upload path, the expand compute shader turns these into atom and bond objects
+  BufferResource position_buffer{};
+  BufferResource atom_tag_buffer{};
+  BufferResource bond_buffer{};
+  BufferResource expand_data_buffer{};
+  // what position, tag and bond buffer currently hold, they are only rewritten if that changed
+  int64_t written_movie_frame = -1;
+  int64_t written_bond_frame = -1;
+  uint64_t written_tags_version = 0;
+
+  // where this frame's slices of the transient buffer start, passed as dynamic offsets or indirect offset
+  struct {
+    uint32_t camera = 0;
+    uint32_t scene = 0;
+    uint32_t cull = 0;
+    uint32_t offsets = 0;
+    uint32_t dispatch = 0;
+  } transient;
+
+  vk::DescriptorSet globalDescriptorSet, test_compute_shader_set, expand_compute_set;
   vk::Semaphore present_semaphore, render_semaphore;
   vk::Fence render_fence;
   vk::CommandPool command_pool;
   vk::CommandBuffer main_command_buffer;
+
+  // the passes are recorded into secondary command buffers by worker threads, one pool per thread
+  struct RecordingPool {
+    vk::CommandPool pool;
+    std::vector<vk::CommandBuffer> command_buffers;
+    uint32_t used = 0;
+  };
+  std::vector<RecordingPool> recording_pools;
 };
 
 struct SpecializationConstants {
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "Eigen/Dense"
+#include "frame_provider.hpp"
 #include <glm/glm.hpp>
 #include <fstream>
 #include <iostream>
+#include <array>
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace rcc {
 
@@ -22,14 +25,34 @@ enum Tags : uint32_t {
   eSelectedForTagging = 1 << 8
 };
 
+// bond between two atoms of a frame, positions and colors are resolved when the object buffer is written
+// the second atom is shifted into the periodic image next to the first one: pos2 = position(atom2) + cell * image
 struct Bond {
-  Bond(glm::vec3 ppos1, glm::vec3 ppos2, glm::vec3 pcolor1, glm::vec3 pcolor2) :
-      pos1{ppos1}, pos2{ppos2}, color1{pcolor1}, color2{pcolor2} {
-  }
-  const glm::vec3 pos1;
-  const glm::vec3 pos2;
-  const glm::vec3 color1;
-  const glm::vec3 color2;
+  uint32_t atom1;
+  uint32_t atom2;
+  std::array<int16_t, 3> image;
+  uint16_t padding = 0;
+
+  auto operator<=>(const Bond &other) const = default;
+};
+
+// connectivity that is shared by all frames, every frame only stores the bonds that differ from the reference
+struct BondTopology {
+  struct FrameDelta {
+    std::vector<Bond> formed;
+    std::vector<Bond> broken;
+  };
+  std::vector<Bond> reference;
+  std::vector<FrameDelta> deltas;
+
+  void applyDelta(uint32_t frameIndex, std::vector<Bond> &frameBonds) const;
+};
+
+// eCellList bins the atoms and only tests pairs in neighboring bins, eBruteForce tests all pairs and is kept as reference
+// both produce the exact same bonds in the same order, tests/bond_search_test.cpp compares them
+enum class BondSearchMode {
+  eCellList,
+  eBruteForce
 };
 
 struct ElementInfo {
@@ -52,7 +75,12 @@ struct Event {
   glm::vec3 connectionNormal{0.f};
 };
 
+class BondFrameCache;
+
 struct VisualizationData {
+  VisualizationData();
+  ~VisualizationData();
+
   //unitCell and PBC
   glm::mat3 unitCellGLM;
   Eigen::Matrix3f unitCellEigen = Eigen::Matrix3f::Zero();
@@ -63,23 +91,42 @@ struct VisualizationData {
   Eigen::Matrix<int, Eigen::Dynamic, 1> hinuma_atom_numbers;
 
   // Atoms
-  std::vector<Eigen::MatrixX3f> positions;
+  FrameProvider positions;
   Eigen::Vector<uint32_t, Eigen::Dynamic> atomIDs;
   Eigen::Vector<uint32_t, Eigen::Dynamic> tags;
   std::map<uint32_t, ElementInfo> elementInfos;
 
   // Bonds
+  // either every frame is created upfront in bonds or frames are created on demand in bondCache
+  // (from the positions or from bondTopology)
   std::vector<std::vector<Bond>> bonds;
+  std::unique_ptr<BondFrameCache> bondCache;
+  BondTopology bondTopology;
+  // upper bound for the bond count of every frame, the draw call buffer layout is based on it
+  uint32_t maxBondCount = 0;
 
   // Active Event
   std::unique_ptr<Event> activeEvent;
 
-  void createBonds(float fudgeFactor);
+  void createBonds(float fudgeFactor, BondSearchMode mode = BondSearchMode::eCellList);
+  void createLazyBonds(float fudgeFactor, size_t cacheCapacity, uint32_t maxBondsPerAtom,
+                       BondSearchMode mode = BondSearchMode::eCellList);
+  void createStaticBondTopology(float fudgeFactor, size_t cacheCapacity,
+                                BondSearchMode mode = BondSearchMode::eCellList);
+  void prefetchBonds(uint32_t frameIndex, int direction, uint32_t window) const;
+  [[nodiscard]] const std::vector<Bond> &frameBonds(uint32_t frameIndex) const;
+  [[nodiscard]] std::pair<glm::vec3, glm::vec3> bondPositions(uint32_t frameIndex, const Bond &bond) const;
+  [[nodiscard]] bool hasBonds() const { return !bonds.empty() || bondCache!=nullptr; }
   [[nodiscard]] Eigen::Vector3f calcMicDisplacementVec(const Eigen::Vector3f &pos1, const Eigen::Vector3f &pos2) const;
 
  private:
-  void createBondsForNonRegularCell(float fudgeFactor);
-  void createBondsForRegularCell(float fudgeFactor);
+  [[nodiscard]] bool isOrthorhombicCell() const;
+  void createFrameBonds(uint32_t frameIndex, float fudgeFactor, BondSearchMode mode,
+                        std::vector<Bond> &frameBonds) const;
+  void createBondsForNonRegularCell(const FrameProvider::Frame &framePositions, float fudgeFactor, BondSearchMode mode,
+                                    std::vector<Bond> &frameBonds) const;
+  void createBondsForRegularCell(const FrameProvider::Frame &framePositions, float fudgeFactor, BondSearchMode mode,
+                                 std::vector<Bond> &frameBonds) const;
 };
 
 } // namespace rcc
\ No newline at end of file
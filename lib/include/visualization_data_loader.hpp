@@ -4,9 +4,13 @@
 #pragma once
 
 #include "visualization_data.hpp"
+#include <atomic>
+#include <future>
 #include <memory>
 #include <sqlite3.h>
 #include <iostream>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace rcc {
@@ -26,10 +30,56 @@ struct ExperimentIDTriplets {
   std::vector<id_tuple> experimentSystemSettingIDs;
 };
 
-struct SqlPositionReaderHelper {
-  int indexCounter = 0;
-  int atomCount = 0;
-  std::vector<Eigen::MatrixX3f> *allPositions = nullptr;
+// connection for a single loader task, sqlite connections are not shared between the threads of a parallel load
+class ReadOnlyConnection {
+ public:
+  explicit ReadOnlyConnection(const std::string &filepath);
+  ~ReadOnlyConnection();
+  ReadOnlyConnection(const ReadOnlyConnection &) = delete;
+  ReadOnlyConnection &operator=(const ReadOnlyConnection &) = delete;
+  ReadOnlyConnection(ReadOnlyConnection &&other) noexcept : db_{std::exchange(other.db_, nullptr)} {}
+
+  operator sqlite3 *() const { return db_; }
+
+ private:
+  sqlite3 *db_ = nullptr;
+};
+
+// statement of the VisDataManager statement cache, it is reset when it goes out of scope so the next user gets it
+// without the rows and bindings of this one
+class CachedStatement {
+ public:
+  explicit CachedStatement(sqlite3_stmt *statement) : statement_{statement} {}
+  ~CachedStatement() {
+    if (!statement_) return;
+    sqlite3_reset(statement_);
+    sqlite3_clear_bindings(statement_);
+  }
+  CachedStatement(const CachedStatement &) = delete;
+  CachedStatement &operator=(const CachedStatement &) = delete;
+
+  operator sqlite3_stmt *() const { return statement_; }
+
+ private:
+  sqlite3_stmt *statement_;
+};
+
+// what a load is doing at the moment, see VisDataManager::loadAsync
+enum class LoadStage {
+  eIdle,
+  eTopology,
+  eFrames,
+  eBonds,
+  eDone
+};
+
+// lazy: bonds are created for the displayed frames only and kept in a cache of cachedFrames frames
+// staticTopology: bonds of all frames are stored as differences to the first frame, ignored if lazy is set
+struct BondLoadSettings {
+  bool lazy = false;
+  bool staticTopology = false;
+  uint32_t cachedFrames = 64;
+  uint32_t maxBondsPerAtom = 12;
 };
 
 class VisDataManager {
@@ -39,7 +89,9 @@ class VisDataManager {
   VisDataManager(const std::string &db_filepath);
   ~VisDataManager();
   //TODO: delete copy and assignment op's
+  // writes the property of all atoms selected for tagging in the background, the in memory tags are not touched
   void updatePropertyForSelectedAtomsToDB(int experimentID, int propertyID, int value);
+  void waitForTagWrites();
   int getCatalystBaseTypeID();
   int getChemicalBaseTypeID();
   void exportExperimentIDTriplets(ExperimentIDTriplets &experiments);
@@ -49,7 +101,19 @@ class VisDataManager {
   void loadActiveEvent(int eventID);
   void unloadActiveEvent();
   void load(int experiment_id);
+  // loads on a background thread, data() may be used once loadedFrameCount() is not zero. the unit cell, elements,
+  // tags and hinuma vectors are complete at that point, positions only for the first loadedFrameCount() frames
+  // and the bonds once isBondsLoaded() is set
+  void loadAsync(int experiment_id);
+  void waitForLoad();
   void unload();
+  void setBondLoadSettings(const BondLoadSettings &settings) { bondSettings_ = settings; }
+  // read positions, tags, element infos and unit cell from the <db>.<experiment>.redres-cache file if it is up to date
+  void setUseTrajectoryCache(bool useCache) { useTrajectoryCache_ = useCache; }
+  // keep the positions in a memory mapped file instead of memory, needs the trajectory cache to be enabled
+  void setStreamPositions(bool stream) { streamPositions_ = stream; }
+  // number of read only connections the frames are split across when loading from the database, 0 uses one per core
+  void setLoaderConnections(uint32_t connections) { loaderConnections_ = connections; }
 
 
   [[nodiscard]] const VisualizationData &data() const { return *vis; }
@@ -61,6 +125,14 @@ class VisDataManager {
   [[nodiscard]] int getExperimentCount();
   [[nodiscard]] int getFirstExperimentID();
 
+  [[nodiscard]] bool isLoading() const { return loadStage_!=LoadStage::eIdle && loadStage_!=LoadStage::eDone; }
+  [[nodiscard]] LoadStage loadStage() const { return loadStage_; }
+  [[nodiscard]] uint32_t loadedFrameCount() const { return loadedFrames_.load(std::memory_order_acquire); }
+  [[nodiscard]] uint32_t totalFrameCount() const { return totalFrames_; }
+  [[nodiscard]] bool isBondsLoaded() const { return bondsLoaded_.load(std::memory_order_acquire); }
+
+  // changes whenever the tags may have changed, handing out the mutable reference counts as a change
+  [[nodiscard]] uint64_t tagsVersion() const { return tagsVersion_; }
   Eigen::Vector<uint32_t, Eigen::Dynamic> &getTagsRef();
   void addEventTags(const Event &event);
   void negateSelectedByAreaTags();
@@ -71,22 +143,62 @@ class VisDataManager {
   void makeSelectedAreaCatalyst();
 
  private:
-  void loadUnitCell(int systemID);
-  void loadElementInfos(int systemID);
-  void loadAtomPositions(int systemID);
-  void loadHinuma(int experimentID);
-  void loadAtomElementNumbersAndTags(int experimentID);
+  // frames are read in about this many batches, the display is updated after every batch
+  static constexpr uint32_t kLoadBatches = 32;
+
+  void beginLoad(int experiment_id);
+  void loadData();
+  void publishFrames(uint32_t frameCount);
+
+  // the loaders take the connection to read from, so they can run concurrently on their own connections
+  void loadUnitCell(sqlite3 *connection, int systemID);
+  void loadElementInfos(sqlite3 *connection, int systemID);
+  // returns the id of the first position row, the rows of all frames follow it in frame and atom order
+  sqlite3_int64 allocatePositions(sqlite3 *connection, int systemID);
+  void loadAtomPositions(std::vector<ReadOnlyConnection> &connections, sqlite3_int64 firstPositionID,
+                         uint32_t firstFrame, uint32_t lastFrame);
+  void loadFramePositions(sqlite3 *connection, sqlite3_int64 firstPositionID, uint32_t firstFrame, uint32_t lastFrame);
+  void loadHinuma(sqlite3 *connection, int experimentID);
+  void loadAtomElementNumbersAndTags(sqlite3 *connection, int experimentID);
 
   void connectToDB(int open_db_flags = SQLITE_OPEN_READONLY);
   void disconnectFromDB();
 
-  void loadBonds(int settingID);
+  // statements of the main connection are prepared once and kept by their sql text until the connection is closed
+  [[nodiscard]] CachedStatement statement(const char *sql) const;
+  void finalizeStatements();
+  // ids that are constant for a database are looked up once, cachedID is -1 until then
+  int lookupID(const char *sql, int &cachedID) const;
+
+  void loadBonds(sqlite3 *connection, int settingID);
+
+  bool connectForWriting();
+  void writePropertyForAtoms(const std::vector<int> &atomIDs, int experimentID, int propertyID, int value);
 
   std::unique_ptr<VisualizationData> vis;
+  BondLoadSettings bondSettings_;
+  bool useTrajectoryCache_ = false;
+  bool streamPositions_ = false;
+  uint32_t loaderConnections_ = 0;
+
+  // state of the current load, written by the loading thread
+  std::future<void> loadJob_;
+  bool isBackgroundLoad_ = false;
+  std::atomic<LoadStage> loadStage_{LoadStage::eIdle};
+  std::atomic<uint32_t> loadedFrames_{0};
+  std::atomic<uint32_t> totalFrames_{0};
+  std::atomic<bool> bondsLoaded_{false};
+  std::atomic<bool> cancelLoad_{false};
   int experimentID_ = -1, systemID_ = -1, settingID_ = -1;
+  uint64_t tagsVersion_ = 1;
 
   sqlite3 *db = nullptr;
+  // opened on the first write and kept, only used by the tag writes which run one after another
+  sqlite3 *writeDb = nullptr;
+  std::shared_future<void> tagWrite_;
   std::string db_filepath_;
+  mutable std::unordered_map<std::string, sqlite3_stmt *> statementCache_;
+  mutable int chemicalBaseTypeID_ = -1, catalystBaseTypeID_ = -1, baseTypePropertyID_ = -1;
 };
 
 } // namespace rcc
\ No newline at end of file
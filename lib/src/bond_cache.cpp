@@ -0,0 +1,93 @@
+#include "bond_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <tbb/info.h>
+
+namespace rcc {
+
+BondFrameCache::BondFrameCache(FrameBondBuilder builder, const uint32_t frameCount, const size_t capacity)
+    : builder_{std::move(builder)}, frameCount_{frameCount}, capacity_{std::max<size_t>(capacity, 2)},
+      arena_{std::max(1, tbb::info::default_concurrency()/2), 0} {
+  entries_.reserve(capacity_ + 1);
+}
+
+BondFrameCache::~BondFrameCache() {
+  // running tasks write into entries_, so they have to finish before it is destroyed
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &[frameIndex, entry] : entries_) {
+    entry->ready.wait();
+  }
+}
+
+BondFrameCache::Entry &BondFrameCache::request(const uint32_t frameIndex) {
+  auto it = entries_.find(frameIndex);
+  if (it==entries_.end()) {
+    auto entry = std::make_unique<Entry>();
+    Entry *entryPtr = entry.get();
+    // enqueued tasks run even if no worker is free yet. the promise belongs to the task, the entry may be
+    // evicted as soon as it is ready
+    auto built = std::make_shared<std::promise<void>>();
+    entry->ready = built->get_future().share();
+    arena_.enqueue([this, frameIndex, entryPtr, built]() {
+      try {
+        builder_(frameIndex, entryPtr->bonds);
+        entryPtr->bonds.shrink_to_fit();
+        built->set_value();
+      } catch (...) {
+        built->set_exception(std::current_exception());
+      }
+    });
+    it = entries_.emplace(frameIndex, std::move(entry)).first;
+  }
+  it->second->lastUsed = ++useCounter_;
+  return *it->second;
+}
+
+void BondFrameCache::evict() {
+  while (entries_.size() > capacity_) {
+    auto victim = entries_.end();
+    for (auto it = entries_.begin(); it!=entries_.end(); it++) {
+      // never drop the frame that is currently displayed or a frame that is still being created
+      if (it->first==lastRequestedFrame_) continue;
+      if (it->second->ready.wait_for(std::chrono::seconds(0))!=std::future_status::ready) continue;
+      if (victim==entries_.end() || it->second->lastUsed < victim->second->lastUsed) victim = it;
+    }
+    if (victim==entries_.end()) return;
+    entries_.erase(victim);
+  }
+}
+
+const std::vector<Bond> &BondFrameCache::get(const uint32_t frameIndex) {
+  std::shared_future<void> ready;
+  Entry *entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lastRequestedFrame_ = frameIndex;
+    entry = &request(frameIndex);
+    ready = entry->ready;
+    evict();
+  }
+  ready.wait();
+  return entry->bonds;
+}
+
+void BondFrameCache::prefetch(const uint32_t frameIndex, const int direction, const uint32_t window) {
+  if (frameCount_==0) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // the cache has to keep the prefetched frames next to the current one, otherwise they evict each other
+  const uint32_t frames = std::min<uint32_t>(window, static_cast<uint32_t>(capacity_ - 1));
+  const int64_t step = (direction < 0) ? -1 : 1;
+  for (uint32_t i = 1; i <= std::min(frames, frameCount_ - 1); i++) {
+    const int64_t frame = (static_cast<int64_t>(frameIndex) + step*i)%frameCount_;
+    request(static_cast<uint32_t>((frame + frameCount_)%frameCount_));
+  }
+  evict();
+}
+
+size_t BondFrameCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+} // namespace rcc
@@ -1,31 +1,34 @@
 #include "buffer.hpp"
 #include "mesh.hpp"
+#include <algorithm>
 #include <iostream>
 
 namespace rcc {
 
-uint32_t ResourceManager::next_handle_ = 0;
-
 ResourceManager::ResourceManager(vk::Device &device, VmaAllocator &allocator):
     device_{device}, allocator_{allocator} {
 }
 
 ResourceManager::~ResourceManager() {
-    for (auto& [handle, buffer] : buffers_) {
-        destroyBuffer(buffer);
-    }
+    if (transfer_semaphore_) device_.destroy(transfer_semaphore_);
+    if (transfer_command_pool_) device_.destroy(transfer_command_pool_);
+    buffers_.forEach([this](Buffer& buffer) { destroyBuffer(buffer); });
 }
 
 uint32_t ResourceManager::createBuffer(size_t size, vk::BufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage) {
+    // written by the transfer queue and read by the graphics queue, shared instead of transferring the ownership
+    if ((buffer_usage & vk::BufferUsageFlagBits::eTransferDst) && transfer_queue_family_!=graphics_queue_family_) {
+        return createBuffer(size, buffer_usage, memory_usage, vk::SharingMode::eConcurrent,
+                            {graphics_queue_family_, transfer_queue_family_});
+    }
     return createBuffer(size, buffer_usage, memory_usage, vk::SharingMode::eExclusive, {});
 }
 
 uint32_t ResourceManager::createBuffer(size_t size, vk::BufferUsageFlags buffer_usage, VmaMemoryUsage memory_usage,
                                        vk::SharingMode sharing_mode, const std::vector<uint32_t>& queue_family_indices){
 
-    auto insert_result = buffers_.emplace(next_handle_, Buffer{});
-    assert(insert_result.second); //check if the handle is already in use
-    auto& buffer = insert_result.first->second;
+    const uint32_t handle = buffers_.insert(Buffer{});
+    auto& buffer = buffers_[handle];
 
     buffer.size_ = size;
     buffer.buffer_usage_ = buffer_usage;
@@ -40,7 +43,23 @@ uint32_t ResourceManager::createBuffer(size_t size, vk::BufferUsageFlags buffer_
                     &static_cast<const VmaAllocationCreateInfo&>(allocation_create_info),
                     reinterpret_cast<VkBuffer*>(&buffer.buffer_), &buffer.allocation_, nullptr);
 
-    return next_handle_++;
+    return handle;
+}
+
+uint32_t ResourceManager::createArena(vk::DeviceSize size, vk::DeviceSize alignment, vk::BufferUsageFlags buffer_usage,
+                                      VmaMemoryUsage memory_usage) {
+    const uint32_t arena_handle = createBuffer(size, buffer_usage, memory_usage);
+    getBuffer(arena_handle).arena_alignment_ = std::max<vk::DeviceSize>(alignment, 4);
+    return arena_handle;
+}
+
+BufferResource ResourceManager::allocateFromArena(uint32_t arena_handle, vk::DeviceSize size,
+                                                  vk::DescriptorType descriptor_type) {
+    auto& arena = getBuffer(arena_handle);
+    assert(arena.arena_alignment_!=0);
+    const vk::DeviceSize offset = (arena.arena_head_ + arena.arena_alignment_ - 1)/arena.arena_alignment_*arena.arena_alignment_;
+    arena.arena_head_ = offset + size;
+    return createBufferResource(arena_handle, offset, size, descriptor_type);
 }
 
 
@@ -51,8 +70,8 @@ BufferResource ResourceManager::createBufferResource(uint32_t buffer_handle,
                                                      vk::DeviceSize range,
                                                      vk::DescriptorType descriptor_type) {
 
-    range = (range == VK_WHOLE_SIZE) ? buffers_.at(buffer_handle).size_ : range;
-    auto& buffer = buffers_.at(buffer_handle);
+    auto& buffer = getBuffer(buffer_handle);
+    range = (range == VK_WHOLE_SIZE) ? buffer.size_ : range;
     assert(buffer.size_ >= offset + range);
 
     BufferResource buffer_resource{};
@@ -68,7 +87,7 @@ void *ResourceManager::getMappedData(Buffer &buffer) {
 }
 
 void *ResourceManager::getMappedData(uint32_t buffer_handle) {
-    return getMappedData(buffers_.at(buffer_handle));
+    return getMappedData(getBuffer(buffer_handle));
 }
 
 void ResourceManager::mapBuffer(Buffer &buffer) {
@@ -76,7 +95,7 @@ void ResourceManager::mapBuffer(Buffer &buffer) {
 }
 
 void ResourceManager::mapBuffer(uint32_t buffer_handle) {
-    mapBuffer(buffers_.at(buffer_handle));
+    mapBuffer(getBuffer(buffer_handle));
 }
 
 void ResourceManager::unmapBuffer(Buffer &buffer) {
@@ -84,10 +103,11 @@ void ResourceManager::unmapBuffer(Buffer &buffer) {
     buffer.mapped_data_ = nullptr;
 }
 void ResourceManager::unmapBuffer(uint32_t buffer_handle) {
-    unmapBuffer(buffers_.at(buffer_handle));
+    unmapBuffer(getBuffer(buffer_handle));
 }
 void ResourceManager::destroyBuffer(uint32_t buffer_handle) {
-    destroyBuffer(buffers_.at(buffer_handle));
+    destroyBuffer(getBuffer(buffer_handle));
+    buffers_.erase(buffer_handle);
 }
 
 void ResourceManager::destroyBuffer(Buffer &buffer) {
@@ -98,7 +118,7 @@ void ResourceManager::destroyBuffer(Buffer &buffer) {
 }
 
 void ResourceManager::writeToBuffer(BufferResource buffer_resource, const void *data, vk::DeviceSize size) {
-    Buffer& buffer = buffers_.at(buffer_resource.handle_);
+    Buffer& buffer = getBuffer(buffer_resource.handle_);
     assert(buffer.mapped_data_ != nullptr);
 
     void* final_location = reinterpret_cast<char*>(buffer.mapped_data_) + buffer_resource.descriptor_buffer_info_.offset;
@@ -122,27 +142,110 @@ void ResourceManager::immediateSubmit(UploadContext& upload_context, vk::Queue&
 }
 
 
-void ResourceManager::stageBuffer(void *src, vk::DeviceSize size, BufferResource dest_resource, UploadContext& upload_context, vk::Queue& upload_queue) {
+void ResourceManager::initTransfer(vk::Queue transfer_queue, uint32_t transfer_queue_family,
+                                   uint32_t graphics_queue_family, vk::DeviceSize staging_size) {
+    transfer_queue_ = transfer_queue;
+    transfer_queue_family_ = transfer_queue_family;
+    graphics_queue_family_ = graphics_queue_family;
 
-    auto staging_buffer_handle_ = createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
-    BufferResource staging_buffer_resource = createBufferResource(staging_buffer_handle_, 0, size, vk::DescriptorType::eStorageBuffer);
-    auto& staging_buffer = buffers_.at(staging_buffer_resource.handle_);
+    vk::CommandPoolCreateInfo pool_create_info{vk::CommandPoolCreateFlagBits::eResetCommandBuffer, transfer_queue_family_};
+    transfer_command_pool_ = device_.createCommandPool(pool_create_info);
 
-    mapBuffer(staging_buffer_resource.handle_);
-    writeToBuffer(staging_buffer_resource, src, size);
-    auto& dest_buffer = buffers_.at(dest_resource.handle_);
+    vk::SemaphoreTypeCreateInfo timeline_create_info{vk::SemaphoreType::eTimeline, 0};
+    vk::SemaphoreCreateInfo semaphore_create_info{vk::SemaphoreCreateFlags(), &timeline_create_info};
+    transfer_semaphore_ = device_.createSemaphore(semaphore_create_info);
 
+    staging_ring_.init(staging_size);
+    staging_handle_ = createBuffer(staging_size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_CPU_ONLY);
+    mapBuffer(staging_handle_);
+    staging_data_ = static_cast<char *>(getMappedData(staging_handle_));
+}
+
+void ResourceManager::retireUploads() {
+    const UploadToken completed = device_.getSemaphoreCounterValue(transfer_semaphore_);
+    while (!in_flight_.empty() && in_flight_.front().token <= completed) {
+        staging_ring_.release(in_flight_.front().staging_bytes);
+        in_flight_.front().cmd.reset();
+        free_command_buffers_.push_back(in_flight_.front().cmd);
+        in_flight_.pop_front();
+    }
+}
+
+vk::DeviceSize ResourceManager::allocateStaging(vk::DeviceSize size) {
+    while (true) {
+        retireUploads();
+        if (const auto allocation = staging_ring_.allocate(size)) {
+            recording_.staging_bytes += allocation->charged;
+            return allocation->offset;
+        }
+
+        // the ring is full, wait for the oldest batch. the recorded copies hold memory too, so they go first
+        if (recording_.cmd) submitRecording();
+        vk::SemaphoreWaitInfo wait_info{vk::SemaphoreWaitFlags(), 1, &transfer_semaphore_, &in_flight_.front().token};
+        if (device_.waitSemaphores(wait_info, 10'000'000'000)!=vk::Result::eSuccess) abort();
+    }
+}
+
+void ResourceManager::submitRecording() {
+    recording_.cmd.end();
+    const vk::TimelineSemaphoreSubmitInfo timeline_info{0, nullptr, 1, &recording_.token};
+    vk::SubmitInfo submit_info{0, nullptr, nullptr, 1, &recording_.cmd, 1, &transfer_semaphore_};
+    submit_info.pNext = &timeline_info;
+    transfer_queue_.submit(submit_info, nullptr);
+
+    in_flight_.push_back(recording_);
+    recording_ = UploadBatch{};
+    next_token_++;
+}
+
+UploadToken ResourceManager::stageBufferAsync(const void *src, vk::DeviceSize size, BufferResource dest_resource) {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    auto& dest_buffer = getBuffer(dest_resource.handle_);
     assert(dest_buffer.size_ >= dest_resource.descriptor_buffer_info_.offset + size);
-    immediateSubmit(
-        upload_context,
-        upload_queue,
-        [=](vk::CommandBuffer cmd) {
-        vk::BufferCopy copy{0, dest_resource.descriptor_buffer_info_.offset, size};
-        cmd.copyBuffer(staging_buffer.buffer_, dest_buffer.buffer_, 1, &copy);
-    });
 
-    destroyBuffer(staging_buffer_resource.handle_);
-    buffers_.erase(staging_buffer_resource.handle_);
+    // copies larger than half the ring are split, so one piece can be copied while the next one is written
+    const vk::DeviceSize max_piece = staging_ring_.size()/2;
+    for (vk::DeviceSize copied = 0; copied < size;) {
+        const vk::DeviceSize piece = std::min(max_piece, size - copied);
+        const vk::DeviceSize staging_offset = allocateStaging(piece);
+        memcpy(staging_data_ + staging_offset, static_cast<const char *>(src) + copied, piece);
+
+        if (!recording_.cmd) {
+            if (free_command_buffers_.empty()) {
+                vk::CommandBufferAllocateInfo allocate_info{transfer_command_pool_, vk::CommandBufferLevel::ePrimary, 1};
+                free_command_buffers_.push_back(device_.allocateCommandBuffers(allocate_info)[0]);
+            }
+            recording_.cmd = free_command_buffers_.back();
+            free_command_buffers_.pop_back();
+            recording_.token = next_token_;
+            recording_.cmd.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit, nullptr});
+        }
+        vk::BufferCopy copy{staging_offset, dest_resource.descriptor_buffer_info_.offset + copied, piece};
+        recording_.cmd.copyBuffer(getBuffer(staging_handle_).buffer_, dest_buffer.buffer_, 1, &copy);
+        copied += piece;
+    }
+    return recording_.cmd ? recording_.token : lastSubmittedUpload();
+}
+
+UploadToken ResourceManager::flushUploads() {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    if (recording_.cmd) submitRecording();
+    retireUploads();
+    return lastSubmittedUpload();
+}
+
+bool ResourceManager::isUploadComplete(UploadToken token) {
+    return device_.getSemaphoreCounterValue(transfer_semaphore_) >= token;
+}
+
+void ResourceManager::waitForUpload(UploadToken token) {
+    if (token > lastSubmittedUpload()) flushUploads();
+    vk::SemaphoreWaitInfo wait_info{vk::SemaphoreWaitFlags(), 1, &transfer_semaphore_, &token};
+    if (device_.waitSemaphores(wait_info, 10'000'000'000)!=vk::Result::eSuccess) abort();
+}
+
+void ResourceManager::stageBuffer(const void *src, vk::DeviceSize size, BufferResource dest_resource) {
+    waitForUpload(stageBufferAsync(src, size, dest_resource));
 }
 
 void ResourceManager::readFromBuffer(BufferResource &buffer, uint32_t range, void *data) {
@@ -157,25 +260,18 @@ void ResourceManager::readFromBufferAndClearIt(BufferResource &buffer, uint32_t
     memcpy(data, mapped, range);
     memset(mapped, 0, range);
 }
-Buffer &ResourceManager::getBuffer(uint32_t buffer_handle) {
-    return buffers_.at(buffer_handle);
-}
-
-Buffer &ResourceManager::getBuffer(BufferResource buffer_resource) {
-    return getBuffer(buffer_resource.handle_);
-}
-
 void ResourceManager::clearBuffer(BufferResource buffer_resource) {
-    void* mapped = getMappedData(buffer_resource.handle_);
+    char* mapped = static_cast<char*>(getMappedData(buffer_resource.handle_));
     assert(mapped);
     assert(buffer_resource.descriptor_buffer_info_.range + buffer_resource.descriptor_buffer_info_.offset
-    <= buffers_.at(buffer_resource.handle_).size_);
+    <= getBuffer(buffer_resource.handle_).size_);
 
-    memset(mapped, static_cast<int>(buffer_resource.descriptor_buffer_info_.offset), buffer_resource.descriptor_buffer_info_.range);
+    // arena resources share the buffer, only their own range is cleared
+    memset(mapped + buffer_resource.descriptor_buffer_info_.offset, 0, buffer_resource.descriptor_buffer_info_.range);
 }
 
 
-std::pair<BufferResource, BufferResource> ResourceManager::uploadMesh(Mesh &mesh, UploadContext upload_context_, vk::Queue upload_queue_) {
+std::pair<BufferResource, BufferResource> ResourceManager::uploadMesh(Mesh &mesh) {
 
     size_t vertex_buffer_size = mesh.vertices_.size()*sizeof(BasicVertex);
     //print the value type of the vertices vector
@@ -186,7 +282,8 @@ std::pair<BufferResource, BufferResource> ResourceManager::uploadMesh(Mesh &mesh
         vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
         VMA_MEMORY_USAGE_GPU_ONLY);
     auto vertex_buffer_resource = createBufferResource(vertex_buffer_handle_, 0, vertex_buffer_size, {});
-    stageBuffer(mesh.vertices_.data(), vertex_buffer_size, vertex_buffer_resource, upload_context_, upload_queue_);
+    // the graphics queue waits for the copies, so the mesh can be drawn right away
+    stageBufferAsync(mesh.vertices_.data(), vertex_buffer_size, vertex_buffer_resource);
 
     size_t index_buffer_size = mesh.indices_.size()*sizeof(uint32_t);
     auto index_buffer_handle_ = createBuffer(
@@ -194,10 +291,28 @@ std::pair<BufferResource, BufferResource> ResourceManager::uploadMesh(Mesh &mesh
         vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
         VMA_MEMORY_USAGE_GPU_ONLY);
     auto index_buffer_resource = createBufferResource(index_buffer_handle_, 0, index_buffer_size, {});
-    stageBuffer(mesh.indices_.data(), index_buffer_size, index_buffer_resource, upload_context_, upload_queue_);
+    stageBufferAsync(mesh.indices_.data(), index_buffer_size, index_buffer_resource);
 
     return {vertex_buffer_resource, index_buffer_resource};
 }
 
 
+void TransientAllocator::init(ResourceManager &resource_manager, uint32_t frame_count, vk::DeviceSize frame_size,
+                              vk::DeviceSize alignment, vk::BufferUsageFlags buffer_usage) {
+    const vk::DeviceSize buffer_size = slices_.init(frame_count, frame_size, alignment);
+    handle_ = resource_manager.createBuffer(buffer_size, buffer_usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    resource_manager.mapBuffer(handle_);
+    mapped_data_ = static_cast<char*>(resource_manager.getMappedData(handle_));
+}
+
+void TransientAllocator::beginFrame(uint32_t frame_index) {
+    slices_.beginFrame(frame_index);
+}
+
+uint32_t TransientAllocator::push(const void *data, vk::DeviceSize size) {
+    const vk::DeviceSize offset = slices_.allocate(size);
+    memcpy(mapped_data_ + offset, data, size);
+    return static_cast<uint32_t>(offset);
+}
+
 } // namespace rcc
\ No newline at end of file
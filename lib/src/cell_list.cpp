@@ -0,0 +1,128 @@
+#include "cell_list.hpp"
+#include <cmath>
+
+namespace rcc {
+
+CellList::CellList(const Eigen::Matrix3f &cell, const Eigen::Array3f &periodic, const float cutOffDistance)
+    : cell_{cell}, periodic_{periodic}, cutOffDistance_{cutOffDistance} {
+
+  const float volume = std::abs(cell_.determinant());
+  if (volume < 1e-6f || !(cutOffDistance_ > 0.f) || !std::isfinite(cutOffDistance_)) {
+    // degenerated cell or cutoff, everything ends up in a single bin which is equal to the brute force search
+    valid_ = false;
+    inverseCell_ = Eigen::Matrix3f::Identity();
+    perpendicularWidths_ = Eigen::Array3f::Ones();
+    return;
+  }
+
+  inverseCell_ = cell_.inverse();
+  // the distance between two opposite faces of the cell is the volume divided by the area of the face
+  for (int i = 0; i < 3; i++) {
+    const Eigen::Vector3f faceNormal = cell_.col((i + 1)%3).cross(cell_.col((i + 2)%3));
+    perpendicularWidths_[i] = volume/faceNormal.norm();
+  }
+}
+
+void CellList::build(const Eigen::Ref<const Eigen::MatrixX3f> &positions) {
+  const auto atomCount = static_cast<uint32_t>(positions.rows());
+
+  // fractional coordinates, one atom per row
+  Eigen::MatrixX3f fractional = positions*inverseCell_.transpose();
+
+  for (int d = 0; d < 3; d++) {
+    if (!valid_) {
+      binCount_[d] = 1;
+      fractionalMin_[d] = 0.f;
+      fractionalExtent_[d] = 1.f;
+      continue;
+    }
+
+    if (periodic_[d]!=0.f) {
+      fractional.col(d) = fractional.col(d).array() - fractional.col(d).array().floor();
+      fractionalMin_[d] = 0.f;
+      fractionalExtent_[d] = 1.f;
+    } else {
+      fractionalMin_[d] = (atomCount > 0) ? fractional.col(d).minCoeff() : 0.f;
+      const float maxCoeff = (atomCount > 0) ? fractional.col(d).maxCoeff() : 1.f;
+      fractionalExtent_[d] = std::max(maxCoeff - fractionalMin_[d], 1e-6f);
+    }
+
+    const float binsFitting = fractionalExtent_[d]*perpendicularWidths_[d]/cutOffDistance_;
+    binCount_[d] = std::max(1, static_cast<int>(std::min(binsFitting, 1024.f)));
+  }
+
+  // sparse systems (e.g. a slab with a lot of vacuum) would create mostly empty bins, so cap the bin count
+  // merging bins only makes them larger and never breaks the neighbor criterion
+  const int64_t maxBinCount = std::max<int64_t>(27, 2*static_cast<int64_t>(atomCount));
+  while (static_cast<int64_t>(binCount_[0])*binCount_[1]*binCount_[2] > maxBinCount) {
+    int largest = 0;
+    binCount_.maxCoeff(&largest);
+    binCount_[largest] = std::max(1, binCount_[largest]/2);
+  }
+
+  // assign bins
+  atomBins_.resize(atomCount);
+  for (uint32_t i = 0; i < atomCount; i++) {
+    Eigen::Array3i bin;
+    for (int d = 0; d < 3; d++) {
+      const float relative = (fractional(i, d) - fractionalMin_[d])/fractionalExtent_[d];
+      bin[d] = std::clamp(static_cast<int>(relative*static_cast<float>(binCount_[d])), 0, binCount_[d] - 1);
+    }
+    atomBins_[i] = (bin[0]*binCount_[1] + bin[1])*binCount_[2] + bin[2];
+  }
+
+  // counting sort of the atoms into the bins, atoms stay in ascending order inside a bin
+  binStart_.assign(binCount() + 1, 0);
+  for (uint32_t bin : atomBins_) binStart_[bin + 1]++;
+  for (uint32_t b = 0; b < binCount(); b++) binStart_[b + 1] += binStart_[b];
+
+  binAtoms_.resize(atomCount);
+  std::vector<uint32_t> fill(binStart_.begin(), binStart_.end() - 1);
+  for (uint32_t i = 0; i < atomCount; i++) {
+    binAtoms_[fill[atomBins_[i]]++] = i;
+  }
+
+  buildNeighborBins();
+}
+
+void CellList::buildNeighborBins() {
+  neighborStart_.assign(1, 0);
+  neighborBins_.clear();
+  neighborBins_.reserve(binCount()*27);
+
+  std::vector<uint32_t> neighbors;
+  neighbors.reserve(27);
+
+  for (int x = 0; x < binCount_[0]; x++) {
+    for (int y = 0; y < binCount_[1]; y++) {
+      for (int z = 0; z < binCount_[2]; z++) {
+        neighbors.clear();
+        for (int dx = -1; dx <= 1; dx++) {
+          for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+              Eigen::Array3i neighbor{x + dx, y + dy, z + dz};
+              bool outside = false;
+              for (int d = 0; d < 3; d++) {
+                if (neighbor[d] >= 0 && neighbor[d] < binCount_[d]) continue;
+                if (periodic_[d]!=0.f && valid_) {
+                  neighbor[d] = (neighbor[d] + binCount_[d])%binCount_[d];
+                } else {
+                  outside = true;
+                }
+              }
+              if (outside) continue;
+              neighbors.push_back((neighbor[0]*binCount_[1] + neighbor[1])*binCount_[2] + neighbor[2]);
+            }
+          }
+        }
+        // with less than three bins in a periodic direction the same bin is reached over both sides
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        neighborBins_.insert(neighborBins_.end(), neighbors.begin(), neighbors.end());
+        neighborStart_.push_back(static_cast<uint32_t>(neighborBins_.size()));
+      }
+    }
+  }
+}
+
+} // namespace rcc
@@ -5,6 +5,7 @@
 #include "pipeline.hpp"
 #include "swapchain.hpp"
 #include "window.hpp"
+#include "lod_ranges.hpp"
 #include <GLFW/glfw3.h>
 
 #define VMA_IMPLEMENTATION
@@ -12,11 +13,16 @@
 
 #include "VkBootstrap.h"
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <limits>
 #include <thread>
 #include <iostream>
 #include <glm/gtx/vector_angle.hpp>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 
 namespace {
   glm::vec4 normalizePlane(const glm::vec4 &plane) {
@@ -68,6 +74,13 @@ Engine::Engine(const char *db_filepath, const char *asset_dir_path) {
   clearColor = getConfig()["ClearColor"].get<std::array<float, 4>>();
   max_cell_count_ = getConfig()["MaxCellCount"].get<int>();
   framerate_control_.movie_framerate_ = Engine::getConfig()["MovieFrameRate"].get<int>();
+  gpu_object_expansion_ = getConfig()["GpuObjectExpansion"].get<bool>();
+  idle_.enabled = getConfig()["SkipUnchangedFrames"].get<bool>();
+  occlusion_culling_enabled_ = getConfig()["OcclusionCulling"].get<bool>();
+  impostor_rendering_ = getConfig()["ImpostorRendering"].get<bool>();
+  lod_error_threshold_ = getConfig()["LodErrorThreshold"].get<float>();
+  // the resident trajectory is read by the expand shader, so it needs the positions only path
+  gpu_resident_trajectory_ = gpu_object_expansion_ && getConfig()["GpuResidentTrajectory"].get<bool>();
 
   //window creation
   std::string windowName = getConfig()["WindowName"].get<std::string>();
@@ -80,6 +93,8 @@ Engine::Engine(const char *db_filepath, const char *asset_dir_path) {
 void Engine::init() {
   initVulkan();
   resource_manager_ = std::make_unique<ResourceManager>(logical_device_, allocator_);
+  resource_manager_->initTransfer(transfer_queue_, transfer_queue_family_, graphics_queue_family_,
+                                  getConfig()["StagingBufferSizeMB"].get<vk::DeviceSize>()*1024*1024);
   initCamera();
   recreateSwapchain();
   initCommands();
@@ -121,7 +136,7 @@ void Engine::initVulkan() {
 
   vkb::PhysicalDeviceSelector selector{vkbInstance};
   vkb::PhysicalDevice vkbPhysicalDevice = selector
-      .set_minimum_version(1, 1)
+      .set_minimum_version(1, 2)
       .set_surface(surface_)
       .set_required_features(required_features)
       .prefer_gpu_device_type(vkb::PreferredDeviceType::discrete)
@@ -132,7 +147,18 @@ void Engine::initVulkan() {
 
   VkPhysicalDeviceShaderDrawParametersFeatures shader_draw_parameters_features =
       static_cast<VkPhysicalDeviceShaderDrawParametersFeatures>(vk::PhysicalDeviceShaderDrawParametersFeatures(VK_TRUE));
-  vkb::Device vkbDevice = deviceBuilder.add_pNext(&shader_draw_parameters_features).build().value();
+  deviceBuilder.add_pNext(&shader_draw_parameters_features);
+
+  // timeline semaphores track the uploads. drawIndirectCount lets the culling pass decide how many draws are
+  // submitted, draw() falls back without it
+  auto supported = vk::PhysicalDevice(vkbPhysicalDevice.physical_device)
+      .getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+  draw_indirect_count_supported_ = supported.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+  VkPhysicalDeviceVulkan12Features vulkan12_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  vulkan12_features.timelineSemaphore = VK_TRUE;
+  vulkan12_features.drawIndirectCount = draw_indirect_count_supported_ ? VK_TRUE : VK_FALSE;
+  deviceBuilder.add_pNext(&vulkan12_features);
+  vkb::Device vkbDevice = deviceBuilder.build().value();
 
   logical_device_ = vkbDevice.device;
   physical_device_ = vkbPhysicalDevice.physical_device;
@@ -140,6 +166,15 @@ void Engine::initVulkan() {
 
   graphics_queue_ = vkbDevice.get_queue(vkb::QueueType::graphics).value();
   graphics_queue_family_ = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
+  // uploads run next to the rendering on a queue family that only transfers, if the device has one
+  auto transfer_queue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+  if (transfer_queue.has_value()) {
+    transfer_queue_ = transfer_queue.value();
+    transfer_queue_family_ = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+  } else {
+    transfer_queue_ = graphics_queue_;
+    transfer_queue_family_ = graphics_queue_family_;
+  }
 
   static VmaVulkanFunctions vulkanFunctions = {};
   vulkanFunctions.vkGetInstanceProcAddr = vkGetInstanceProcAddr;
@@ -252,6 +287,7 @@ void Engine::run() {
 
   while (!window_->shouldClose()) {
     glfwPollEvents();
+    if (waitForInputIfIdle()) continue;
 
     //read buffers from last frame
     long int frame_index = ((framerate_control_.frame_number_ - 1)%FRAMES_IN_FLIGHT);
@@ -262,9 +298,14 @@ void Engine::run() {
         sizeof(uint32_t)*RCC_MOUSE_BUCKET_COUNT,
         mouse_buckets);
 
+    showLoadedExperiment();
     if (experiment_state_ != State::eNone) {
-      // update selected index variable
-      processMousePickingBuffer();
+      // update selected index variable, selecting changes the tags which are still read while loading
+      if (scene_->visManager->isLoading()) {
+        bReadMousePickingBuffer_ = false;
+      } else {
+        processMousePickingBuffer();
+      }
       processMouseDrag();
       if (!framerate_control_.manualFrameControl) {
         float ms_per_frame = 1000.f/static_cast<float>(framerate_control_.movie_framerate_);
@@ -276,6 +317,10 @@ void Engine::run() {
               (framerate_control_.isSimulationLooped) ? 0 : static_cast<float>(scene_->MovieFrameCount() - 1);
         }
       }
+      // only the frames loaded so far can be shown
+      framerate_control_.movie_frame_index_ =
+          std::min(framerate_control_.movie_frame_index_, static_cast<float>(scene_->MovieFrameCount() - 1));
+      prefetchMovieFrames();
     }
     ui->show();
 
@@ -319,6 +364,8 @@ void Engine::recreateSwapchain() {
                                              previousSwapchain);
   }
 
+  // the depth pyramid belongs to the swapchain, the first sets are built in initDescriptors
+  if (depth_pyramid_descriptor_set_layout) buildDepthPyramidDescriptorSets();
 }
 
 void Engine::initCommands() {
@@ -334,11 +381,19 @@ void Engine::initCommands() {
 
     frame.main_command_buffer = logical_device_.allocateCommandBuffers(cmdBufferAllocateInfo)[0];
 
+    // one pool per thread that records passes, see recordFramePasses
+    frame.recording_pools.resize(tbb::this_task_arena::max_concurrency());
+    for (auto &recording_pool : frame.recording_pools) {
+      recording_pool.pool = logical_device_.createCommandPool(
+          vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphics_queue_family_));
+    }
+
     main_destruction_stack_.push([=]() {
 #ifdef RCC_DESTROY_MESSAGES
       std::cout << "Destroying Command Pool\n";
 #endif
       logical_device_.destroy(frame.command_pool);
+      for (const auto &recording_pool : frame.recording_pools) logical_device_.destroy(recording_pool.pool);
     });
   }
 
@@ -402,72 +457,160 @@ void Engine::render() {
   framerate_control_.frame_time_ = static_cast<float>(std::chrono::duration<double, std::chrono::milliseconds::period>(
       new_time - framerate_control_.currentTime).count());
 
-  double minMs = (1000./framerate_control_.max_framerate_);
-  if (framerate_control_.frame_time_ < minMs) {
-    std::chrono::duration<double, std::milli> waiting_time(minMs - framerate_control_.frame_time_);
-    auto delta_ms_duration = std::chrono::duration_cast<std::chrono::milliseconds>(waiting_time).count();
-    std::this_thread::sleep_for(std::chrono::milliseconds(delta_ms_duration));
-  }
+  // the frame rate limit is waited for after the buffer writes were handed off, so they overlap the wait
+  const double minMs = (1000./framerate_control_.max_framerate_);
+  const std::chrono::duration<double, std::milli>
+      waiting_time(std::max(0., minMs - static_cast<double>(framerate_control_.frame_time_)));
 
   framerate_control_.avgFrameTime.feed(framerate_control_.frame_time_);
   framerate_control_.currentTime = new_time;
 
-
-
-  //acquireNextImage gives us the index of an available swapchain image we can render into
-  //the semaphore given is signaled if the image was presented
-  //signals a semaphore when the
-  auto [result, swapchainIndex] = swapchain_->acquireNextImage(getCurrentFrame().present_semaphore);
-  if (result==vk::Result::eErrorOutOfDateKHR) {
-    recreateSwapchain();
-    return;
-  }
-
-  // we wait on the fence before writing our buffers
+  // we wait on the fence before writing our buffers. it is only reset right before the submit, a frame that
+  // is dropped because the swapchain is out of date leaves it signaled
   const auto fence_wait_result =
       logical_device_.waitForFences(getCurrentFrame().render_fence, true, 1'000'000'000); //timeout in nanoseconds
   if (fence_wait_result!=vk::Result::eSuccess) abort();
-  logical_device_.resetFences(getCurrentFrame().render_fence);
 
   if (experiment_state_ != eNone) {
     //reset IndirectDrawClearBuffer if we have a new Experiment
-
-    if (experiment_state_ == State::eNew) {
+    const bool new_experiment = experiment_state_==State::eNew;
+    if (new_experiment) {
+      // the other frames in flight still read the meshes and copy from the clear draw call buffer
+      logical_device_.waitIdle();
       loadMeshes();
       writeClearDrawCallBuffer();
+      for (auto &frame : frame_data_) {
+        frame.written_movie_frame = -1;
+        frame.written_bond_frame = -1;
+        frame.written_tags_version = 0;
+      }
+      releaseTrajectory();
+      visibility_cleared_ = false;
+      for (auto &written_state : written_render_states_) written_state.reset();
       experiment_state_ = State::eOld;
     }
+    // switching between meshes and impostors or loading the bonds changes the draw commands,
+    // frames in flight still copy the old ones
+    if (!(currentDrawCallLayout()==written_draw_call_layout_)) {
+      logical_device_.waitIdle();
+      writeClearDrawCallBuffer();
+    }
+    // bonds are loaded after the atoms, so the capacity is checked every frame
+    reserveObjectBuffers(new_experiment);
 
-    writeIndirectDispatchBuffer();
-    writeObjectAndInstanceBuffer();
-    writeOffsetBuffer();
-    writeCameraBuffer();
-    writeSceneBuffer();
-    writeCullBuffer();
+    // frames are loaded in the background, the trajectory is uploaded once the last one arrived
+    if (gpu_resident_trajectory_ && !trajectory_checked_
+        && scene_->visManager->loadedFrameCount()==scene_->visManager->totalFrameCount()) {
+      uploadTrajectory();
+    }
+    finishTrajectoryUpload();
+
+    // only the buffers whose inputs changed since this frame wrote them last are written again
+    updateCamera();
+    const RenderState render_state = currentRenderState();
+    auto &written_state = written_render_states_[getCurrentFrameIndex()];
+    const bool objects_changed = !written_state || !(written_state->objects==render_state.objects);
+    const bool view_changed = !written_state || !(written_state->view==render_state.view);
+    idle_.unchanged_frames = (objects_changed || view_changed) ? 0 : idle_.unchanged_frames + 1;
+
+    // written before the object writes start, writeOffsetBuffer clamps the cell counts in the scene config
+    writeTransientData();
+    written_state = render_state;
+
+    // the gpu is done with this frame's buffers. the writes only read the scene, which is not changed again
+    // before the preparation is joined, and this frame's buffers, which nothing else touches until the submit
+    if (objects_changed) {
+      frame_preparation_.run([this]() {
+        if (gpu_object_expansion_) {
+          writeExpandBuffers();
+        } else {
+          writeObjectAndInstanceBuffer();
+        }
+      });
+    }
+  } else {
+    idle_.unchanged_frames++;
   }
 
-  // begin and record cmd buffer
-  auto &cmd = getCurrentFrame().main_command_buffer;
-  vk::CommandBufferBeginInfo cmd_begin_info{};
-  cmd.begin(cmd_begin_info);
+  // the secondary command buffers of this frame's last use are done, its fence signaled
+  for (auto &recording_pool : getCurrentFrame().recording_pools) {
+    logical_device_.resetCommandPool(recording_pool.pool);
+    recording_pool.used = 0;
+  }
 
-  if (experiment_state_ != eNone) {
-    resetDrawData(cmd, clear_draw_call_buffer_, getCurrentFrame().draw_call_buffer, sizeof(GPUDrawCalls));
-    runCullComputeShader(cmd);
+  std::this_thread::sleep_until(new_time + waiting_time);
+
+  //acquireNextImage gives us the index of an available swapchain image we can render into
+  //the semaphore given is signaled if the image was presented
+  auto [result, swapchainIndex] = swapchain_->acquireNextImage(getCurrentFrame().present_semaphore);
+  if (result==vk::Result::eErrorOutOfDateKHR) {
+    frame_preparation_.wait();
+    recreateSwapchain();
+    return;
   }
 
-  beginRenderPass(cmd, swapchainIndex);
-  if (experiment_state_ != eNone) draw(cmd);
-  ui->writeDrawDataToCmdBuffer(cmd);
-  cmd.endRenderPass();
-  cmd.end();
+  const bool occlusion_culling = isOcclusionCullingActive();
+  // occlusion culling is off by default, its depth reduction is only built once it is turned on
+  if (occlusion_culling && !depth_reduce_compute_pipeline_) {
+    depth_reduce_compute_pipeline_ = createComputePipeline(
+        getConfig()["AssetDirectoryFilepath"].get<std::string>() + getConfig()["DepthReduceShaderFilepath"].get<std::string>(),
+        depth_reduce_pipeline_layout_);
+  }
+  const bool experiment_loaded = experiment_state_ != eNone;
+  std::vector<FramePass> passes;
+  if (experiment_loaded) {
+    passes.push_back({vk::RenderPass{}, [this, occlusion_culling](vk::CommandBuffer cmd) {
+      resetDrawData(cmd, clear_draw_call_buffer_, getCurrentFrame().draw_call_buffer, sizeof(GPUDrawCalls));
+      if (occlusion_culling) {
+        resetDrawData(cmd, clear_draw_call_buffer_, getCurrentFrame().late_draw_call_buffer, sizeof(GPUDrawCalls));
+      }
+      if (gpu_object_expansion_) runExpandComputeShader(cmd);
+      runCullComputeShader(cmd, occlusion_culling ? eCullEarly : eCullSinglePass);
+    }});
+  }
+
+  if (occlusion_culling) {
+    // draw what was visible last frame, build the depth pyramid from it and draw what became visible
+    passes.push_back({swapchain_->earlyRenderPass(), [this](vk::CommandBuffer cmd) {
+      setViewportAndScissor(cmd);
+      draw(cmd, getCurrentFrame().draw_call_buffer);
+    }});
+    passes.push_back({vk::RenderPass{}, [this](vk::CommandBuffer cmd) {
+      buildDepthPyramid(cmd);
+      runCullComputeShader(cmd, eCullLate);
+    }});
+    passes.push_back({swapchain_->lateRenderPass(), [this](vk::CommandBuffer cmd) {
+      setViewportAndScissor(cmd);
+      draw(cmd, getCurrentFrame().late_draw_call_buffer);
+    }});
+  } else if (experiment_loaded) {
+    passes.push_back({swapchain_->renderPass(), [this](vk::CommandBuffer cmd) {
+      setViewportAndScissor(cmd);
+      draw(cmd, getCurrentFrame().draw_call_buffer);
+    }});
+  }
+  passes.push_back({occlusion_culling ? swapchain_->lateRenderPass() : swapchain_->renderPass(),
+                    [this](vk::CommandBuffer cmd) { ui->writeDrawDataToCmdBuffer(cmd); }});
+
+  auto &cmd = getCurrentFrame().main_command_buffer;
+  recordFramePasses(cmd, swapchainIndex, passes);
+
+  // the buffers have to be written before the submit makes them visible to the gpu
+  frame_preparation_.wait();
+  logical_device_.resetFences(getCurrentFrame().render_fence);
 
   {
     // Wait in the command buffer at the pipeline stage eColorAttachmentOutput until the image was acquired
+    // and before anything else until the uploads staged so far are copied
     // signal render fence and render_semaphore when the submitted command buffer is done
-    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    vk::SubmitInfo submit_info
-        {1, &getCurrentFrame().present_semaphore, &waitStage, 1, &cmd, 1, &getCurrentFrame().render_semaphore};
+    const std::array<vk::Semaphore, 2> wait_semaphores{getCurrentFrame().present_semaphore,
+                                                      resource_manager_->transferSemaphore()};
+    const std::array<vk::PipelineStageFlags, 2> wait_stages{vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                                            vk::PipelineStageFlagBits::eAllCommands};
+    const std::array<uint64_t, 2> wait_values{0, resource_manager_->flushUploads()};
+    const vk::TimelineSemaphoreSubmitInfo timeline_info{2, wait_values.data(), 0, nullptr};
+    vk::SubmitInfo submit_info{wait_semaphores, wait_stages, cmd, getCurrentFrame().render_semaphore};
+    submit_info.pNext = &timeline_info;
     graphics_queue_.submit(1, &submit_info, getCurrentFrame().render_fence);
   }
 
@@ -484,14 +627,15 @@ void Engine::render() {
   }
 }
 
-void Engine::draw(vk::CommandBuffer &cmd) {
+void Engine::draw(vk::CommandBuffer &cmd, const BufferResource &draw_calls) {
 
   //bind Global Descriptor Set and Vertex-/Index-Buffers
-  uint32_t gpu_ubo_offset = paddedUniformBufferSize(sizeof(GPUSceneData)) * getCurrentFrameIndex();
+  // dynamic offsets in binding order: camera, scene, offsets
+  const auto &transient = getCurrentFrame().transient;
+  const std::array<uint32_t, 3> dynamic_offsets{transient.camera, transient.scene, transient.offsets};
 
   cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics_pipeline_layout_,
-                         0, 1, &getCurrentFrame().globalDescriptorSet,
-                         1, &gpu_ubo_offset);
+                         0, getCurrentFrame().globalDescriptorSet, dynamic_offsets);
 
     auto& vertex_buffer = resource_manager_->getBuffer(meshes.accumulated_mesh_->vertexBuffer_.handle_);
     auto& index_buffer = resource_manager_->getBuffer(meshes.accumulated_mesh_->indexBuffer_.handle_);
@@ -499,82 +643,226 @@ void Engine::draw(vk::CommandBuffer &cmd) {
     cmd.bindVertexBuffers(0, vertex_buffer.buffer_, {0});
     cmd.bindIndexBuffer(index_buffer.buffer_, 0, vk::IndexType::eUint32);
 
-  if (camera_->is_isometric) {
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, atom_pipeline_iso_->pipeline());
-  } else {
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, atom_pipeline_->pipeline());
-  }
-
-  if ((*scene_)["Atom"].isLoaded() && (*scene_)["Atom"].shown) {
-
-    //auto indices = meshes.meshInfos[meshID::eAtom].indexCount;
-    //cmd.drawIndexed(indices, 1400, 0, 0, 0);
-
-    cmd.drawIndexedIndirect(resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_,
-                            sizeof(vk::DrawIndexedIndirectCommand)*meshID::eAtom,
-                            1,
-                            sizeof(vk::DrawIndexedIndirectCommand));
-
-     }
-
-    if ((*scene_)["UnitCell"].isLoaded() && (*scene_)["UnitCell"].shown) {
-      cmd.drawIndexedIndirect(resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_,
-                              sizeof(vk::DrawIndexedIndirectCommand)*meshID::eUnitCell,
-                              1,
-                              sizeof(vk::DrawIndexedIndirectCommand));
+  // one draw per pipeline. the culling pass compacts the commands that got instances into the list of their
+  // group and counts them, hidden or unloaded types never get instances and are not drawn
+  const vk::Buffer draw_call_buffer = resource_manager_->getBuffer(draw_calls.handle_).buffer_;
+  const vk::DeviceSize draw_call_offset = draw_calls.descriptor_buffer_info_.offset; // range of the device arena
+  constexpr uint32_t command_count = RCC_MESH_COUNT*RCC_LOD_COUNT;
+  const bool iso = camera_->is_isometric;
+  for (uint32_t group = 0; group < RCC_DRAW_GROUP_COUNT; group++) {
+    if (std::find(draw_groups_.begin(), draw_groups_.end(), group)==draw_groups_.end()) continue;
+
+    switch (group) {
+      case eDrawGroupMesh:
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, (iso ? atom_pipeline_iso_ : atom_pipeline_)->pipeline());
+        break;
+      case eDrawGroupBond:
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, (iso ? bond_pipeline_iso_ : bond_pipeline_)->pipeline());
+        break;
+      case eDrawGroupAtomImpostor:
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                         (iso ? atom_impostor_pipeline_iso_ : atom_impostor_pipeline_)->pipeline());
+        break;
+      case eDrawGroupBondImpostor:
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                         (iso ? bond_impostor_pipeline_iso_ : bond_impostor_pipeline_)->pipeline());
+        break;
+      default:
+        break;
     }
 
-    if ((*scene_)["Vector"].isLoaded() && (*scene_)["Vector"].shown) {
-      cmd.drawIndexedIndirect(resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_,
-                              sizeof(vk::DrawIndexedIndirectCommand)*meshID::eVector,
-                              1,
-                              sizeof(vk::DrawIndexedIndirectCommand));
-    }
-
-    if ((*scene_)["Cylinder"].isLoaded() && (*scene_)["Cylinder"].shown) {
-      cmd.drawIndexedIndirect(resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_,
-                              sizeof(vk::DrawIndexedIndirectCommand)*meshID::eCylinder,
-                              1,
-                              sizeof(vk::DrawIndexedIndirectCommand));
-    }
-
-    if (camera_->is_isometric) {
-      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, bond_pipeline_iso_->pipeline());
+    if (draw_indirect_count_supported_) {
+      cmd.drawIndexedIndirectCount(draw_call_buffer,
+                                   draw_call_offset + offsetof(GPUDrawCalls, compactedCommands)
+                                       + sizeof(vk::DrawIndexedIndirectCommand)*command_count*group,
+                                   draw_call_buffer,
+                                   draw_call_offset + offsetof(GPUDrawCalls, drawCounts) + sizeof(uint32_t)*group,
+                                   command_count,
+                                   sizeof(vk::DrawIndexedIndirectCommand));
     } else {
-      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, bond_pipeline_->pipeline());
-    }
-
-    if ((*scene_)["Bond"].isLoaded() && (*scene_)["Bond"].shown) {
-      cmd.drawIndexedIndirect(resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_,
-                              sizeof(vk::DrawIndexedIndirectCommand)*meshID::eBond,
-                              1,
-                              sizeof(vk::DrawIndexedIndirectCommand));
+      // every command of the group is submitted, the empty ones draw nothing
+      for (uint32_t command = 0; command < command_count; command++) {
+        if (draw_groups_[command]!=group) continue;
+        cmd.drawIndexedIndirect(draw_call_buffer,
+                                draw_call_offset + offsetof(GPUDrawCalls, commands)
+                                    + sizeof(vk::DrawIndexedIndirectCommand)*command,
+                                1,
+                                sizeof(vk::DrawIndexedIndirectCommand));
+      }
     }
+  }
 }
 
-void Engine::runCullComputeShader(vk::CommandBuffer cmd) {
-  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, culling_compute_pipeline_);
+void Engine::runCullComputeShader(vk::CommandBuffer cmd, CullPhase phase) {
+  using acs = vk::AccessFlagBits;
+  using stage = vk::PipelineStageFlagBits;
+  const vk::Buffer cluster_dispatch_buffer =
+      resource_manager_->getBuffer(getCurrentFrame().cluster_dispatch_buffer.handle_).buffer_;
+  // the dispatch and the draw calls are ranges of the device arena
+  const vk::DeviceSize cluster_dispatch_offset = getCurrentFrame().cluster_dispatch_buffer.descriptor_buffer_info_.offset;
+  const vk::Buffer visible_cluster_buffer =
+      resource_manager_->getBuffer(getCurrentFrame().visible_cluster_buffer.handle_).buffer_;
+  const vk::Buffer visibility_buffer = resource_manager_->getBuffer(visibility_buffer_.handle_).buffer_;
+
+  // nothing was visible before the first frame, everything is tested in the late pass then
+  // only the early pass clears, the late pass of the same frame is recorded in parallel
+  if (phase==eCullEarly && !visibility_cleared_) {
+    cmd.fillBuffer(visibility_buffer, 0, VK_WHOLE_SIZE, 0);
+    vk::BufferMemoryBarrier clear_barrier{acs::eTransferWrite, acs::eShaderRead | acs::eShaderWrite,
+                                          graphics_queue_family_, graphics_queue_family_,
+                                          visibility_buffer, 0, VK_WHOLE_SIZE};
+    cmd.pipelineBarrier(stage::eTransfer, stage::eComputeShader, {}, nullptr, clear_barrier, nullptr);
+    visibility_cleared_ = true;
+  }
+
+  // the cluster pass counts the visible clusters into the dispatch of the object pass
+  const GPUClusterDispatch empty_dispatch{{0, 1, 1}, 0};
+  cmd.updateBuffer(cluster_dispatch_buffer, cluster_dispatch_offset, sizeof(GPUClusterDispatch), &empty_dispatch);
+  vk::BufferMemoryBarrier reset_barrier{acs::eTransferWrite, acs::eShaderRead | acs::eShaderWrite,
+                                        graphics_queue_family_, graphics_queue_family_,
+                                        cluster_dispatch_buffer, cluster_dispatch_offset, sizeof(GPUClusterDispatch)};
+  cmd.pipelineBarrier(stage::eTransfer, stage::eComputeShader, {}, nullptr, reset_barrier, nullptr);
+
+  const std::array<vk::DescriptorSet, 2> cull_sets{getCurrentFrame().test_compute_shader_set, depth_pyramid_set_};
+  // dynamic offsets in binding order: cull data, offsets
+  const auto &transient = getCurrentFrame().transient;
+  const std::array<uint32_t, 2> dynamic_offsets{transient.cull, transient.offsets};
   cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
                          culling_compute_pipeline_layout_,
                          0,
-                         getCurrentFrame().test_compute_shader_set,
-                         {});
+                         cull_sets,
+                         dynamic_offsets);
+  const uint32_t phase_constant = phase;
+  cmd.pushConstants(culling_compute_pipeline_layout_, vk::ShaderStageFlagBits::eCompute,
+                    0, sizeof(uint32_t), &phase_constant);
+
+  // one workgroup per cluster, tested once per periodic image
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cluster_culling_compute_pipeline_);
+  cmd.dispatchIndirect(resource_manager_->getBuffer(transient_allocator_.handle()).buffer_, transient.dispatch);
+
+  std::vector<vk::BufferMemoryBarrier> cluster_barriers = {
+      vk::BufferMemoryBarrier{acs::eShaderWrite, acs::eShaderRead,
+                              graphics_queue_family_, graphics_queue_family_,
+                              visible_cluster_buffer, 0, VK_WHOLE_SIZE},
+      vk::BufferMemoryBarrier{acs::eShaderWrite, acs::eIndirectCommandRead | acs::eShaderRead,
+                              graphics_queue_family_, graphics_queue_family_,
+                              cluster_dispatch_buffer, cluster_dispatch_offset, sizeof(GPUClusterDispatch)}
+  };
+  cmd.pipelineBarrier(stage::eComputeShader, stage::eComputeShader | stage::eDrawIndirect,
+                      vk::DependencyFlags(), nullptr, cluster_barriers, nullptr);
 
-  cmd.dispatchIndirect(resource_manager_->getBuffer(indirect_dispatch_buffer_.handle_).buffer_, 0);
+  // one workgroup per visible cluster and periodic image, one invocation per object
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, culling_compute_pipeline_);
+  cmd.dispatchIndirect(cluster_dispatch_buffer, cluster_dispatch_offset);
+
+  const BufferResource &draw_calls =
+      (phase==eCullLate) ? getCurrentFrame().late_draw_call_buffer : getCurrentFrame().draw_call_buffer;
+
+  // the commands that got instances are compacted per draw group for drawIndexedIndirectCount
+  if (draw_indirect_count_supported_) {
+    const vk::BufferMemoryBarrier command_barrier{acs::eShaderWrite, acs::eShaderRead | acs::eShaderWrite,
+                                                  graphics_queue_family_, graphics_queue_family_,
+                                                  resource_manager_->getBuffer(draw_calls.handle_).buffer_,
+                                                  draw_calls.descriptor_buffer_info_.offset, sizeof(GPUDrawCalls)};
+    cmd.pipelineBarrier(stage::eComputeShader, stage::eComputeShader, {}, nullptr, command_barrier, nullptr);
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, compact_draws_compute_pipeline_);
+    cmd.dispatch(1, 1, 1);
+  }
 
+  // the late pass reads the draw counts of the early pass and the next frame reads the visibility
   std::vector<vk::BufferMemoryBarrier> barriers = {
       vk::BufferMemoryBarrier{vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eMemoryRead,
                               graphics_queue_family_, graphics_queue_family_,
                               resource_manager_->getBuffer(getCurrentFrame().final_instance_buffer.handle_).buffer_, 0,
-                              MAX_UNIQUE_OBJECTS*sizeof(GPUFinalInstance)*27},
+                              VK_WHOLE_SIZE},
       vk::BufferMemoryBarrier{vk::AccessFlagBits::eMemoryWrite | vk::AccessFlagBits::eMemoryRead,
                               vk::AccessFlagBits::eMemoryRead,
                               graphics_queue_family_, graphics_queue_family_,
-                              resource_manager_->getBuffer(getCurrentFrame().draw_call_buffer.handle_).buffer_, 0,
-                              sizeof(GPUDrawCalls)}
+                              resource_manager_->getBuffer(draw_calls.handle_).buffer_,
+                              draw_calls.descriptor_buffer_info_.offset, sizeof(GPUDrawCalls)}
   };
+  if (phase==eCullLate) {
+    barriers.emplace_back(acs::eShaderWrite, acs::eShaderRead | acs::eShaderWrite,
+                          graphics_queue_family_, graphics_queue_family_,
+                          visibility_buffer, 0, VK_WHOLE_SIZE);
+  }
 
-  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexShader,
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                      stage::eVertexShader | stage::eDrawIndirect | stage::eComputeShader,
+                      vk::DependencyFlags(), nullptr, barriers, nullptr);
+}
+
+bool Engine::isOcclusionCullingActive() const {
+  // with culling switched off every object is drawn anyway
+  return occlusion_culling_enabled_ && isCullingEnabled && experiment_state_!=eNone;
+}
+
+void Engine::buildDepthPyramid(vk::CommandBuffer cmd) {
+  using acs = vk::AccessFlagBits;
+  using stage = vk::PipelineStageFlagBits;
+  const vk::Image pyramid = swapchain_->depthPyramid();
+  const uint32_t levels = swapchain_->depthPyramidLevels();
+
+  // every level is written again, the old content can be discarded
+  vk::ImageMemoryBarrier discard_barrier{acs::eShaderRead, acs::eShaderWrite,
+                                         vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                                         graphics_queue_family_, graphics_queue_family_, pyramid,
+                                         vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1}};
+  cmd.pipelineBarrier(stage::eComputeShader, stage::eComputeShader, {}, nullptr, nullptr, discard_barrier);
+
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, depth_reduce_compute_pipeline_);
+  vk::Extent2D input_extent = swapchain_->extent();
+  const vk::Extent2D pyramid_extent = swapchain_->depthPyramidExtent();
+  for (uint32_t level = 0; level < levels; level++) {
+    const vk::Extent2D output_extent{std::max(pyramid_extent.width >> level, 1u),
+                                     std::max(pyramid_extent.height >> level, 1u)};
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, depth_reduce_pipeline_layout_,
+                           0, depth_reduce_sets_[level], {});
+    const GPUDepthReduceConstants constants{output_extent.width, output_extent.height,
+                                            input_extent.width, input_extent.height};
+    cmd.pushConstants(depth_reduce_pipeline_layout_, vk::ShaderStageFlagBits::eCompute,
+                      0, sizeof(GPUDepthReduceConstants), &constants);
+    cmd.dispatch((output_extent.width + 15)/16, (output_extent.height + 15)/16, 1);
+
+    // the next level and the late culling pass read this one
+    vk::ImageMemoryBarrier level_barrier{acs::eShaderWrite, acs::eShaderRead,
+                                         vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral,
+                                         graphics_queue_family_, graphics_queue_family_, pyramid,
+                                         vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, level, 1, 0, 1}};
+    cmd.pipelineBarrier(stage::eComputeShader, stage::eComputeShader, {}, nullptr, nullptr, level_barrier);
+    input_extent = output_extent;
+  }
+}
+
+void Engine::runExpandComputeShader(vk::CommandBuffer cmd) {
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, expand_compute_pipeline_);
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                         expand_compute_pipeline_layout_,
+                         0,
+                         getCurrentFrame().expand_compute_set,
+                         {});
+
+  const uint32_t movie_frame = GetMovieFrameIndex();
+  uint32_t object_count = 0;
+  if (scene_->isWritten(meshID::eAtom)) object_count += (*scene_)["Atom"].Count(movie_frame);
+  if (scene_->isWritten(meshID::eBond)) object_count += (*scene_)["Bond"].Count(movie_frame);
+  if (object_count==0) return;
+  cmd.dispatch(static_cast<uint32_t>(ceil(object_count/256.0)), 1, 1);
+
+  // the culling shader reads the objects and instances written here
+  std::vector<vk::BufferMemoryBarrier> barriers = {
+      vk::BufferMemoryBarrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+                              graphics_queue_family_, graphics_queue_family_,
+                              resource_manager_->getBuffer(getCurrentFrame().object_buffer.handle_).buffer_, 0,
+                              VK_WHOLE_SIZE},
+      vk::BufferMemoryBarrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead,
+                              graphics_queue_family_, graphics_queue_family_,
+                              resource_manager_->getBuffer(getCurrentFrame().instance_buffer.handle_).buffer_, 0,
+                              VK_WHOLE_SIZE}
+  };
+
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                      vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eVertexShader,
                       vk::DependencyFlags(), nullptr, barriers, nullptr);
 }
 
@@ -584,6 +872,7 @@ void Engine::cleanup() {
   swapchain_.reset();
   main_destruction_stack_.flush();
   descriptor_allocator_.cleanup();
+  depth_pyramid_descriptor_allocator_.cleanup();
   layout_cache_.cleanup();
 
 
@@ -591,6 +880,10 @@ void Engine::cleanup() {
   bond_pipeline_.reset(nullptr);
   atom_pipeline_iso_.reset(nullptr);
   bond_pipeline_iso_.reset(nullptr);
+  atom_impostor_pipeline_.reset(nullptr);
+  bond_impostor_pipeline_.reset(nullptr);
+  atom_impostor_pipeline_iso_.reset(nullptr);
+  bond_impostor_pipeline_iso_.reset(nullptr);
 
   instance_.destroy(surface_);
   logical_device_.destroy();
@@ -678,6 +971,73 @@ void Engine::initPipelines() {
                                                   &bondFsSpecializationInfo);
 }
 
+void Engine::initImpostorPipelines() {
+  PipelineConfig config{};
+  Pipeline::defaultPipelineConfigInfo(config);
+  config.renderPass = swapchain_->renderPass();
+  config.pipelineLayout = graphics_pipeline_layout_;
+
+  VertexDescription vertexDescription = BasicVertex::getDescription();
+  config.bindingDescriptions = vertexDescription.bindings_;
+  config.attributeDescriptions = vertexDescription.attributes_;
+
+  // the isometric variants only differ in a specialization constant
+  const std::string atom_impostor_vs_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+      + getConfig()["AtomImpostorVertexShaderFilepath"].get<std::string>();
+  const std::string atom_impostor_fs_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+      + getConfig()["AtomImpostorFragmentShaderFilepath"].get<std::string>();
+  const std::string bond_impostor_vs_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+      + getConfig()["BondImpostorVertexShaderFilepath"].get<std::string>();
+  const std::string bond_impostor_fs_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+      + getConfig()["BondImpostorFragmentShaderFilepath"].get<std::string>();
+
+  struct ImpostorSpecializationConstants {
+    SpecializationConstants base;
+    vk::Bool32 isometric;
+  } impostor_constants{{}, VK_FALSE}, impostor_constants_iso{{}, VK_TRUE};
+  std::vector<vk::SpecializationMapEntry> impostor_specializations;
+  impostor_specializations.emplace_back(0,
+                                        offsetof(ImpostorSpecializationConstants, base.point_light_count),
+                                        sizeof(uint32_t));
+  impostor_specializations.emplace_back(1,
+                                        offsetof(ImpostorSpecializationConstants, base.mouse_bucket_count),
+                                        sizeof(uint32_t));
+  impostor_specializations.emplace_back(2,
+                                        offsetof(ImpostorSpecializationConstants, isometric),
+                                        sizeof(vk::Bool32));
+  vk::SpecializationInfo impostorSpecializationInfo{static_cast<uint32_t>(impostor_specializations.size()),
+                                                    impostor_specializations.data(),
+                                                    sizeof(impostor_constants), &impostor_constants};
+  vk::SpecializationInfo impostorIsoSpecializationInfo{static_cast<uint32_t>(impostor_specializations.size()),
+                                                       impostor_specializations.data(),
+                                                       sizeof(impostor_constants_iso), &impostor_constants_iso};
+
+  atom_impostor_pipeline_ = std::make_unique<Pipeline>(logical_device_,
+                                                       config,
+                                                       atom_impostor_vs_path,
+                                                       atom_impostor_fs_path,
+                                                       &impostorSpecializationInfo,
+                                                       &impostorSpecializationInfo);
+  atom_impostor_pipeline_iso_ = std::make_unique<Pipeline>(logical_device_,
+                                                           config,
+                                                           atom_impostor_vs_path,
+                                                           atom_impostor_fs_path,
+                                                           &impostorIsoSpecializationInfo,
+                                                           &impostorIsoSpecializationInfo);
+  bond_impostor_pipeline_ = std::make_unique<Pipeline>(logical_device_,
+                                                       config,
+                                                       bond_impostor_vs_path,
+                                                       bond_impostor_fs_path,
+                                                       &impostorSpecializationInfo,
+                                                       &impostorSpecializationInfo);
+  bond_impostor_pipeline_iso_ = std::make_unique<Pipeline>(logical_device_,
+                                                           config,
+                                                           bond_impostor_vs_path,
+                                                           bond_impostor_fs_path,
+                                                           &impostorIsoSpecializationInfo,
+                                                           &impostorIsoSpecializationInfo);
+}
+
 void Engine::initScene() {
 
   auto &reciprocal_gamma = scene_data_.params[0][0];
@@ -697,7 +1057,7 @@ void Engine::initScene() {
 }
 
 void Engine::loadMeshes() {
-  Mesh atom_mesh, unit_cell_mesh, vector_mesh, cylinder_mesh, bond_mesh;
+  Mesh atom_mesh, unit_cell_mesh, vector_mesh, cylinder_mesh, bond_mesh, impostor_quad_mesh, impostor_box_mesh;
 
   unit_cell_mesh.createUnitCellMesh(scene_->cellGLM());
   unit_cell_mesh.calcRadius();
@@ -706,6 +1066,7 @@ void Engine::loadMeshes() {
       getConfig()["AssetDirectoryFilepath"].get<std::string>() + getConfig()["SphereMeshFilepath"].get<std::string>());
   atom_mesh.optimizeMesh();
   atom_mesh.calcRadius();
+  atom_mesh.generateLods(RCC_LOD_COUNT);
 
   cylinder_mesh.loadFromObjFile(getConfig()["AssetDirectoryFilepath"].get<std::string>()
                                     + getConfig()["CylinderMeshFilepath"].get<std::string>());
@@ -721,14 +1082,16 @@ void Engine::loadMeshes() {
       getConfig()["AssetDirectoryFilepath"].get<std::string>() + getConfig()["BondMeshFilepath"].get<std::string>());
   bond_mesh.calcRadius();
   bond_mesh.optimizeMesh();
+  bond_mesh.generateLods(RCC_LOD_COUNT);
+
+  impostor_quad_mesh.createImpostorQuad();
+  impostor_box_mesh.createImpostorBox();
 
 
     // destroy old meshes
   if (meshes.accumulated_mesh_) {
     resource_manager_->destroyBuffer(meshes.accumulated_mesh_->vertexBuffer_.handle_);
     resource_manager_->destroyBuffer(meshes.accumulated_mesh_->indexBuffer_.handle_);
-    resource_manager_->buffers_.erase(meshes.accumulated_mesh_->vertexBuffer_.handle_);
-    resource_manager_->buffers_.erase(meshes.accumulated_mesh_->indexBuffer_.handle_);
     meshes.accumulated_mesh_.reset(nullptr);
   }
 
@@ -740,9 +1103,11 @@ void Engine::loadMeshes() {
       .addMesh(unit_cell_mesh, meshID::eUnitCell, atom_pipeline_->pipeline(), graphics_pipeline_layout_)
       .addMesh(vector_mesh, meshID::eVector, atom_pipeline_->pipeline(), graphics_pipeline_layout_)
       .addMesh(cylinder_mesh, meshID::eCylinder, atom_pipeline_->pipeline(), graphics_pipeline_layout_)
-      .addMesh(bond_mesh, meshID::eBond, bond_pipeline_->pipeline(), graphics_pipeline_layout_);
+      .addMesh(bond_mesh, meshID::eBond, bond_pipeline_->pipeline(), graphics_pipeline_layout_)
+      .addMesh(impostor_quad_mesh, meshID::eImpostorQuad, vk::Pipeline{}, graphics_pipeline_layout_)
+      .addMesh(impostor_box_mesh, meshID::eImpostorBox, vk::Pipeline{}, graphics_pipeline_layout_);
   std::tie(meshes.accumulated_mesh_->vertexBuffer_, meshes.accumulated_mesh_->indexBuffer_)
-  = resource_manager_->uploadMesh(*(meshes.accumulated_mesh_), upload_context_, graphics_queue_);
+  = resource_manager_->uploadMesh(*(meshes.accumulated_mesh_));
 
   scene_->setMeshes(&meshes);
 }
@@ -764,117 +1129,280 @@ void Engine::initDescriptors() {
   using buf = vk::BufferUsageFlagBits;
 
   descriptor_allocator_.init(logical_device_);
+  depth_pyramid_descriptor_allocator_.init(logical_device_);
   layout_cache_.init(logical_device_);
 
-  auto clear_draw_command_handle = resource_manager_->createBuffer(sizeof(GPUDrawCalls), buf::eTransferSrc | buf::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
-  clear_draw_call_buffer_ = resource_manager_->createBufferResource(
-      clear_draw_command_handle, 0, sizeof(GPUDrawCalls), {});
+  // the small fixed size buffers of all frames are ranges of two arenas instead of one allocation each
+  const vk::DeviceSize arena_alignment = std::max(gpu_properties_.limits.minUniformBufferOffsetAlignment,
+                                                  gpu_properties_.limits.minStorageBufferOffsetAlignment);
+  const auto aligned = [arena_alignment](vk::DeviceSize size) {
+    return (size + arena_alignment - 1)/arena_alignment*arena_alignment;
+  };
+  const vk::DeviceSize host_arena_frame_size = aligned(sizeof(mouse_buckets)) + aligned(sizeof(GPUExpandData));
+  const vk::DeviceSize device_arena_frame_size = 2*aligned(sizeof(GPUDrawCalls)) + aligned(sizeof(GPUClusterDispatch));
+  host_arena_ = resource_manager_->createArena(FRAMES_IN_FLIGHT*host_arena_frame_size, arena_alignment,
+                                               buf::eUniformBuffer | buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  resource_manager_->mapBuffer(host_arena_);
+  device_arena_ = resource_manager_->createArena(aligned(sizeof(GPUDrawCalls)) + FRAMES_IN_FLIGHT*device_arena_frame_size,
+                                                 arena_alignment,
+                                                 buf::eStorageBuffer | buf::eIndirectBuffer | buf::eTransferSrc
+                                                     | buf::eTransferDst,
+                                                 VMA_MEMORY_USAGE_GPU_ONLY);
+
+  clear_draw_call_buffer_ = resource_manager_->allocateFromArena(device_arena_, sizeof(GPUDrawCalls), {});
+
+  // what the cpu writes every frame, see writeTransientData
+  const vk::DeviceSize transient_frame_size = aligned(sizeof(vk::DispatchIndirectCommand)) + aligned(sizeof(GPUOffsets))
+      + aligned(sizeof(GPUCamData)) + aligned(sizeof(GPUSceneData)) + aligned(sizeof(GPUCullData));
+  transient_allocator_.init(*resource_manager_, FRAMES_IN_FLIGHT, transient_frame_size, arena_alignment,
+                            buf::eUniformBuffer | buf::eStorageBuffer | buf::eIndirectBuffer);
+
+  createVisibilityBuffer(object_capacity_);
 
+  for (auto &frame : frame_data_) {
 
-  auto indirect_dispatch_buffer_handle = resource_manager_->createBuffer(sizeof(vk::DispatchIndirectCommand), buf::eIndirectBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-  indirect_dispatch_buffer_ = resource_manager_->createBufferResource(
-      indirect_dispatch_buffer_handle, 0, sizeof(vk::DispatchIndirectCommand), {});
-  resource_manager_->mapBuffer(indirect_dispatch_buffer_handle);
+    using desc = vk::DescriptorType;
+    frame.mouseBucketBuffer = resource_manager_->allocateFromArena(host_arena_, sizeof(mouse_buckets), desc::eStorageBuffer);
+    if (gpu_object_expansion_) {
+      frame.expand_data_buffer =
+          resource_manager_->allocateFromArena(host_arena_, sizeof(GPUExpandData), desc::eStorageBuffer);
+    }
 
-    const size_t sceneDataBufferSize = FRAMES_IN_FLIGHT*paddedUniformBufferSize(sizeof(GPUSceneData));
-    uint32_t scene_data_buffer_handle = resource_manager_->createBuffer(sceneDataBufferSize, vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    resource_manager_->mapBuffer(scene_data_buffer_handle);
-    scene_data_buffer_ = resource_manager_->createBufferResource(
-        scene_data_buffer_handle, 0, sizeof(GPUSceneData), vk::DescriptorType::eUniformBufferDynamic);
+    frame.draw_call_buffer =
+        resource_manager_->allocateFromArena(device_arena_, sizeof(GPUDrawCalls), desc::eStorageBuffer);
+    frame.cluster_dispatch_buffer =
+        resource_manager_->allocateFromArena(device_arena_, sizeof(GPUClusterDispatch), desc::eStorageBuffer);
+    frame.late_draw_call_buffer =
+        resource_manager_->allocateFromArena(device_arena_, sizeof(GPUDrawCalls), desc::eStorageBuffer);
 
-  for (auto &frame : frame_data_) {
+    // the buffers that scale with the experiment start small, see reserveObjectBuffers
+    createObjectBuffers(frame, object_capacity_);
+    buildDescriptorSets(frame);
 
-    auto mouse_bucket_buffer_handle = resource_manager_->
-        createBuffer(sizeof(mouse_buckets), buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.mouseBucketBuffer = resource_manager_->
-        createBufferResource(mouse_bucket_buffer_handle, 0, sizeof(mouse_buckets), vk::DescriptorType::eStorageBuffer);
-    resource_manager_->mapBuffer(mouse_bucket_buffer_handle);
-
-    auto cam_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUCamData), buf::eUniformBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.cam_buffer = resource_manager_->
-        createBufferResource(cam_buffer_handle, 0, sizeof(GPUCamData), vk::DescriptorType::eUniformBuffer);
-    resource_manager_->mapBuffer(cam_buffer_handle);
-
-    auto object_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUObjectData)*MAX_UNIQUE_OBJECTS, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.object_buffer = resource_manager_->
-        createBufferResource(object_buffer_handle, 0, sizeof(GPUObjectData)*MAX_UNIQUE_OBJECTS, vk::DescriptorType::eStorageBuffer);
-    resource_manager_->mapBuffer(object_buffer_handle);
-
-    auto cull_data_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUCullData), buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.cull_data_buffer = resource_manager_->
-        createBufferResource(cull_data_buffer_handle, 0, sizeof(GPUCullData), vk::DescriptorType::eStorageBuffer);
-    resource_manager_->mapBuffer(cull_data_buffer_handle);
-
-    auto offset_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUOffsets), buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.offset_buffer = resource_manager_->
-        createBufferResource(offset_buffer_handle, 0, sizeof(GPUOffsets), vk::DescriptorType::eStorageBuffer);
-    resource_manager_->mapBuffer(offset_buffer_handle);
-
-    auto instance_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUInstance)*MAX_UNIQUE_OBJECTS, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.instance_buffer = resource_manager_->
-        createBufferResource(instance_buffer_handle, 0, sizeof(GPUInstance)*MAX_UNIQUE_OBJECTS, vk::DescriptorType::eStorageBuffer);
-    resource_manager_->mapBuffer(instance_buffer_handle);
-
-    auto final_instance_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUFinalInstance)*MAX_UNIQUE_OBJECTS*27, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    frame.final_instance_buffer = resource_manager_->
-        createBufferResource(final_instance_buffer_handle, 0, sizeof(GPUFinalInstance)*MAX_UNIQUE_OBJECTS*27, vk::DescriptorType::eStorageBuffer);
-
-    auto draw_call_buffer_handle = resource_manager_->
-        createBuffer(sizeof(GPUDrawCalls), buf::eStorageBuffer | buf::eIndirectBuffer | buf::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
-    frame.draw_call_buffer = resource_manager_->
-        createBufferResource(draw_call_buffer_handle, 0, sizeof(GPUDrawCalls), vk::DescriptorType::eStorageBuffer);
-
-    // 3. Bondage
-    DescriptorBuilder::begin(&layout_cache_, &descriptor_allocator_)
-        .bindBuffer(0,
-                    frame.cam_buffer,
-                    vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
-        .bindBuffer(1,
-                    scene_data_buffer_,
-                    vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
-        .bindBuffer(2,
-                    frame.object_buffer,
-                    vk::ShaderStageFlagBits::eVertex)
-        .bindBuffer(3,
-                    frame.mouseBucketBuffer,
-                    vk::ShaderStageFlagBits::eFragment)
-        .bindBuffer(4,
-                    frame.final_instance_buffer,
-                    vk::ShaderStageFlagBits::eVertex)
-        .bindBuffer(5,
-                    frame.offset_buffer,
-                    vk::ShaderStageFlagBits::eVertex)
-        .build(frame.globalDescriptorSet, graphics_descriptor_set_layout);
+    resource_manager_->clearBuffer(frame.mouseBucketBuffer);
+  }
+
+  buildDepthPyramidDescriptorSets();
+}
+
+void Engine::createVisibilityBuffer(const ObjectCapacity &capacity) {
+  using buf = vk::BufferUsageFlagBits;
+  auto visibility_buffer_handle = resource_manager_->
+      createBuffer(sizeof(uint32_t)*capacity.objects, buf::eStorageBuffer | buf::eTransferDst, VMA_MEMORY_USAGE_GPU_ONLY);
+  visibility_buffer_ = resource_manager_->
+      createBufferResource(visibility_buffer_handle, 0, sizeof(uint32_t)*capacity.objects, vk::DescriptorType::eStorageBuffer);
+  visibility_cleared_ = false;
+}
+
+void Engine::buildDepthPyramidDescriptorSets() {
+  depth_pyramid_descriptor_allocator_.reset_pools();
+
+  // level 0 is reduced from the depth image, every other level from the one below
+  const uint32_t levels = swapchain_->depthPyramidLevels();
+  depth_reduce_sets_.resize(levels);
+  for (uint32_t level = 0; level < levels; level++) {
+    vk::DescriptorImageInfo input_info{swapchain_->depthPyramidSampler(),
+                                       (level==0) ? swapchain_->depthView() : swapchain_->depthPyramidMipView(level - 1),
+                                       (level==0) ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eGeneral};
+    vk::DescriptorImageInfo output_info{{}, swapchain_->depthPyramidMipView(level), vk::ImageLayout::eGeneral};
+    DescriptorBuilder::begin(&layout_cache_, &depth_pyramid_descriptor_allocator_)
+        .bindImage(0, &input_info, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute)
+        .bindImage(1, &output_info, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute)
+        .build(depth_reduce_sets_[level], depth_reduce_descriptor_set_layout);
+  }
+
+  vk::DescriptorImageInfo pyramid_info{swapchain_->depthPyramidSampler(), swapchain_->depthPyramidView(),
+                                       vk::ImageLayout::eGeneral};
+  DescriptorBuilder::begin(&layout_cache_, &depth_pyramid_descriptor_allocator_)
+      .bindImage(0, &pyramid_info, vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute)
+      .build(depth_pyramid_set_, depth_pyramid_descriptor_set_layout);
+}
+
+void Engine::createObjectBuffers(FrameData &frame, const ObjectCapacity &capacity) {
+  using buf = vk::BufferUsageFlagBits;
+
+  auto object_buffer_handle = resource_manager_->
+      createBuffer(sizeof(GPUObjectData)*capacity.objects, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.object_buffer = resource_manager_->
+      createBufferResource(object_buffer_handle, 0, sizeof(GPUObjectData)*capacity.objects, vk::DescriptorType::eStorageBuffer);
+  resource_manager_->mapBuffer(object_buffer_handle);
+
+  auto instance_buffer_handle = resource_manager_->
+      createBuffer(sizeof(GPUInstance)*capacity.objects, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.instance_buffer = resource_manager_->
+      createBufferResource(instance_buffer_handle, 0, sizeof(GPUInstance)*capacity.objects, vk::DescriptorType::eStorageBuffer);
+  resource_manager_->mapBuffer(instance_buffer_handle);
+
+  auto final_instance_buffer_handle = resource_manager_->
+      createBuffer(sizeof(GPUFinalInstance)*capacity.finalInstances(), buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  frame.final_instance_buffer = resource_manager_->
+      createBufferResource(final_instance_buffer_handle, 0, sizeof(GPUFinalInstance)*capacity.finalInstances(), vk::DescriptorType::eStorageBuffer);
+
+  const uint32_t cluster_count = (capacity.objects + RCC_CLUSTER_SIZE - 1)/RCC_CLUSTER_SIZE;
+  auto visible_cluster_buffer_handle = resource_manager_->
+      createBuffer(sizeof(GPUVisibleCluster)*cluster_count*27, buf::eStorageBuffer, VMA_MEMORY_USAGE_GPU_ONLY);
+  frame.visible_cluster_buffer = resource_manager_->
+      createBufferResource(visible_cluster_buffer_handle, 0, sizeof(GPUVisibleCluster)*cluster_count*27, vk::DescriptorType::eStorageBuffer);
+
+  if (gpu_object_expansion_) {
+    auto position_buffer_handle = resource_manager_->
+        createBuffer(sizeof(float)*3*capacity.atoms, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.position_buffer = resource_manager_->
+        createBufferResource(position_buffer_handle, 0, sizeof(float)*3*capacity.atoms, vk::DescriptorType::eStorageBuffer);
+    resource_manager_->mapBuffer(position_buffer_handle);
+
+    auto atom_tag_buffer_handle = resource_manager_->
+        createBuffer(sizeof(uint32_t)*capacity.atoms, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.atom_tag_buffer = resource_manager_->
+        createBufferResource(atom_tag_buffer_handle, 0, sizeof(uint32_t)*capacity.atoms, vk::DescriptorType::eStorageBuffer);
+    resource_manager_->mapBuffer(atom_tag_buffer_handle);
+
+    auto bond_buffer_handle = resource_manager_->
+        createBuffer(sizeof(GPUBond)*capacity.bonds, buf::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    frame.bond_buffer = resource_manager_->
+        createBufferResource(bond_buffer_handle, 0, sizeof(GPUBond)*capacity.bonds, vk::DescriptorType::eStorageBuffer);
+    resource_manager_->mapBuffer(bond_buffer_handle);
+  }
+}
+
+void Engine::destroyObjectBuffers(FrameData &frame) {
+  std::vector<BufferResource *> buffers =
+      {&frame.object_buffer, &frame.instance_buffer, &frame.final_instance_buffer, &frame.visible_cluster_buffer};
+  if (gpu_object_expansion_) {
+    buffers.insert(buffers.end(), {&frame.position_buffer, &frame.atom_tag_buffer, &frame.bond_buffer});
+  }
+  for (auto *buffer : buffers) {
+    resource_manager_->destroyBuffer(buffer->handle_);
+    *buffer = BufferResource{};
+  }
+}
+
+void Engine::buildDescriptorSets(FrameData &frame) {
+  // camera, scene, cull data and offsets are slices of the transient buffer, their offsets are passed when the
+  // sets are bound
+  using desc = vk::DescriptorType;
+  const auto transient = [this](vk::DeviceSize size, vk::DescriptorType type) {
+    return resource_manager_->createBufferResource(transient_allocator_.handle(), 0, size, type);
+  };
 
+  // 3. Bondage
+  DescriptorBuilder::begin(&layout_cache_, &descriptor_allocator_)
+      .bindBuffer(0,
+                  transient(sizeof(GPUCamData), desc::eUniformBufferDynamic),
+                  vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
+      .bindBuffer(1,
+                  transient(sizeof(GPUSceneData), desc::eUniformBufferDynamic),
+                  vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment)
+      .bindBuffer(2,
+                  frame.object_buffer,
+                  vk::ShaderStageFlagBits::eVertex)
+      .bindBuffer(3,
+                  frame.mouseBucketBuffer,
+                  vk::ShaderStageFlagBits::eFragment)
+      .bindBuffer(4,
+                  frame.final_instance_buffer,
+                  vk::ShaderStageFlagBits::eVertex)
+      .bindBuffer(5,
+                  transient(sizeof(GPUOffsets), desc::eStorageBufferDynamic),
+                  vk::ShaderStageFlagBits::eVertex)
+      .build(frame.globalDescriptorSet, graphics_descriptor_set_layout);
+
+  DescriptorBuilder::begin(&layout_cache_, &descriptor_allocator_)
+      .bindBuffer(0,
+                  frame.object_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(1,
+                  transient(sizeof(GPUCullData), desc::eStorageBufferDynamic),
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(2,
+                  frame.instance_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(3,
+                  frame.final_instance_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(4,
+                  frame.draw_call_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(5,
+                  transient(sizeof(GPUOffsets), desc::eStorageBufferDynamic),
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(6,
+                  frame.visible_cluster_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(7,
+                  frame.cluster_dispatch_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(8,
+                  visibility_buffer_,
+                  vk::ShaderStageFlagBits::eCompute)
+      .bindBuffer(9,
+                  frame.late_draw_call_buffer,
+                  vk::ShaderStageFlagBits::eCompute)
+      .build(frame.test_compute_shader_set, culling_descriptor_set_layout);
+
+  if (gpu_object_expansion_) {
     DescriptorBuilder::begin(&layout_cache_, &descriptor_allocator_)
         .bindBuffer(0,
                     frame.object_buffer,
                     vk::ShaderStageFlagBits::eCompute)
         .bindBuffer(1,
-                    frame.cull_data_buffer,
+                    frame.instance_buffer,
                     vk::ShaderStageFlagBits::eCompute)
         .bindBuffer(2,
-                    frame.instance_buffer,
+                    frame.position_buffer,
                     vk::ShaderStageFlagBits::eCompute)
         .bindBuffer(3,
-                    frame.final_instance_buffer,
+                    frame.atom_tag_buffer,
                     vk::ShaderStageFlagBits::eCompute)
         .bindBuffer(4,
-                    frame.draw_call_buffer,
+                    frame.bond_buffer,
                     vk::ShaderStageFlagBits::eCompute)
         .bindBuffer(5,
-                    frame.offset_buffer,
+                    frame.expand_data_buffer,
                     vk::ShaderStageFlagBits::eCompute)
-        .build(frame.test_compute_shader_set, culling_descriptor_set_layout);
+        .build(frame.expand_compute_set, expand_descriptor_set_layout);
+  }
+}
 
-    resource_manager_->clearBuffer(frame.mouseBucketBuffer);
+void Engine::reserveObjectBuffers(bool allow_shrink) {
+  ObjectCapacity required{0, 0, 0};
+  for (const auto &type : scene_->objectTypes) {
+    required.objects += type->MaxCount();
+  }
+  required.atoms = (*scene_)["Atom"].MaxCount();
+  required.bonds = (*scene_)["Bond"].MaxCount();
+  required.objects = std::max(required.objects, MIN_OBJECT_CAPACITY);
+  required.atoms = std::max(required.atoms, MIN_OBJECT_CAPACITY);
+  required.bonds = std::max(required.bonds, MIN_OBJECT_CAPACITY);
+  // the bonds of a new experiment arrive later, until then the old bond buffers are kept
+  if (!(*scene_)["Bond"].isLoaded()) required.bonds = std::max(required.bonds, object_capacity_.bonds);
+
+  // grow to what the experiment needs, shrink only when a much smaller experiment is loaded
+  const auto needsResize = [allow_shrink](uint32_t required_count, uint32_t capacity) {
+    return required_count > capacity || (allow_shrink && required_count < capacity/4);
+  };
+  if (!needsResize(required.objects, object_capacity_.objects)
+      && !needsResize(required.atoms, object_capacity_.atoms)
+      && !needsResize(required.bonds, object_capacity_.bonds)) {
+    return;
   }
+
+  // the old buffers and descriptor sets may still be used by frames in flight
+  logical_device_.waitIdle();
+  descriptor_allocator_.reset_pools();
+  resource_manager_->destroyBuffer(visibility_buffer_.handle_);
+  createVisibilityBuffer(required);
+  for (auto &frame : frame_data_) {
+    destroyObjectBuffers(frame);
+    createObjectBuffers(frame, required);
+    buildDescriptorSets(frame);
+    frame.written_movie_frame = -1;
+    frame.written_bond_frame = -1;
+    frame.written_tags_version = 0;
+  }
+  for (auto &written_state : written_render_states_) written_state.reset();
+  object_capacity_ = required;
+  if (trajectory_uploaded_) bindExpandPositions(true);
 }
 
 
@@ -890,7 +1418,7 @@ size_t Engine::paddedUniformBufferSize(size_t old_size) const {
 }
 
 
-void Engine::beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index) {
+void Engine::beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index, vk::RenderPass render_pass) {
 
   vk::ClearValue clear_value;
   clear_value.color = {clearColor};
@@ -900,11 +1428,17 @@ void Engine::beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index) {
 
   const vk::Extent2D window_extent{static_cast<uint32_t>(window_->width()), static_cast<uint32_t>(window_->height())};
   vk::RenderPassBeginInfo render_pass_begin_info
-      {swapchain_->renderPass(), swapchain_->framebuffer(swapchain_index), vk::Rect2D{{0, 0}, window_extent},
+      {render_pass, swapchain_->framebuffer(swapchain_index), vk::Rect2D{{0, 0}, window_extent},
        clearValues.size(),
        clearValues.data()};
 
-  cmd.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+  // the passes are recorded into secondary command buffers, see recordFramePasses
+  cmd.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eSecondaryCommandBuffers);
+}
+
+void Engine::setViewportAndScissor(vk::CommandBuffer &cmd) {
+  // secondary command buffers don't inherit the dynamic state
+  const vk::Extent2D window_extent{static_cast<uint32_t>(window_->width()), static_cast<uint32_t>(window_->height())};
   vk::Viewport
       viewport{0.f, 0.f, static_cast<float>(window_extent.width), static_cast<float>(window_extent.height), 0.f, 1.f};
   vk::Rect2D scissor{{0, 0}, window_extent};
@@ -912,6 +1446,49 @@ void Engine::beginRenderPass(vk::CommandBuffer &cmd, uint32_t swapchain_index) {
   cmd.setScissor(0, scissor);
 }
 
+void Engine::recordFramePasses(vk::CommandBuffer &cmd, uint32_t swapchain_index, const std::vector<FramePass> &passes) {
+  // every pass is recorded on a worker thread, they only read engine state
+  std::vector<vk::CommandBuffer> secondaries(passes.size());
+  tbb::parallel_for(size_t(0), passes.size(), [&](const size_t i) {
+    const vk::CommandBufferInheritanceInfo inheritance{
+        passes[i].render_pass, 0,
+        passes[i].render_pass ? swapchain_->framebuffer(swapchain_index) : vk::Framebuffer{}};
+    secondaries[i] = beginSecondaryCommandBuffer(inheritance);
+    passes[i].record(secondaries[i]);
+    secondaries[i].end();
+  });
+
+  // the main thread only stitches them together, consecutive passes share one instance of their render pass
+  vk::CommandBufferBeginInfo cmd_begin_info{};
+  cmd.begin(cmd_begin_info);
+  vk::RenderPass open_render_pass{};
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].render_pass!=open_render_pass) {
+      if (open_render_pass) cmd.endRenderPass();
+      if (passes[i].render_pass) beginRenderPass(cmd, swapchain_index, passes[i].render_pass);
+      open_render_pass = passes[i].render_pass;
+    }
+    cmd.executeCommands(secondaries[i]);
+  }
+  if (open_render_pass) cmd.endRenderPass();
+  cmd.end();
+}
+
+vk::CommandBuffer Engine::beginSecondaryCommandBuffer(const vk::CommandBufferInheritanceInfo &inheritance) {
+  // the pool of the recording thread, no other thread uses it during this frame
+  auto &recording_pool = getCurrentFrame().recording_pools[tbb::this_task_arena::current_thread_index()];
+  if (recording_pool.used==recording_pool.command_buffers.size()) {
+    vk::CommandBufferAllocateInfo allocate_info{recording_pool.pool, vk::CommandBufferLevel::eSecondary, 1};
+    recording_pool.command_buffers.push_back(logical_device_.allocateCommandBuffers(allocate_info)[0]);
+  }
+  vk::CommandBuffer secondary = recording_pool.command_buffers[recording_pool.used++];
+
+  vk::CommandBufferUsageFlags usage = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  if (inheritance.renderPass) usage |= vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+  secondary.begin(vk::CommandBufferBeginInfo{usage, &inheritance});
+  return secondary;
+}
+
 
 void Engine::toggleCameraMode() {
   camera_->is_isometric = !camera_->is_isometric;
@@ -937,6 +1514,7 @@ void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int
 }
 
 void Engine::mouseButtonCallback(int button, int action, int mods) {
+  idle_.input_events++;
   if (ui->wantMouse()) return;
 
   if (button==GLFW_MOUSE_BUTTON_LEFT && action==GLFW_PRESS) {
@@ -960,16 +1538,52 @@ void Engine::loadExperiment(int experiment_id){
     return;
   }
 
-  scene_->visManager->load(experiment_id);
+  BondLoadSettings bond_settings;
+  bond_settings.lazy = getConfig()["LazyBonds"].get<bool>();
+  bond_settings.staticTopology = getConfig()["StaticBondTopology"].get<bool>();
+  bond_settings.cachedFrames = getConfig()["BondCacheFrames"].get<uint32_t>();
+  bond_settings.maxBondsPerAtom = getConfig()["MaxBondsPerAtom"].get<uint32_t>();
+  scene_->visManager->setBondLoadSettings(bond_settings);
+  scene_->visManager->setUseTrajectoryCache(getConfig()["UseTrajectoryCache"].get<bool>());
+  scene_->visManager->setStreamPositions(getConfig()["StreamPositions"].get<bool>());
+  scene_->visManager->setLoaderConnections(getConfig()["LoaderConnections"].get<uint32_t>());
+
+  // the experiment is shown by showLoadedExperiment as soon as the first frames are loaded
+  scene_->visManager->loadAsync(experiment_id);
+  experiment_pending_ = true;
+}
+
+void Engine::showLoadedExperiment() {
+  if (!experiment_pending_ || scene_->visManager->loadedFrameCount()==0) return;
+  experiment_pending_ = false;
+
   float dist = glm::length(scene_->visManager->data().unitCellGLM * glm::vec3(1.f, 1.f, 1.f));
   camera_->alignPerspectivePositionToSystemCenter(dist * 1.5f);
+  framerate_control_.movie_frame_index_ = 0;
   experiment_state_ = eNew;
 }
 
+void Engine::prefetchMovieFrames() {
+  // frames ahead in playback direction, when scrubbing manually the direction of the last change is used
+  const auto current_frame = static_cast<uint32_t>(framerate_control_.movie_frame_index_);
+  if (current_frame!=framerate_control_.last_movie_frame_) {
+    framerate_control_.movie_direction_ = (current_frame > framerate_control_.last_movie_frame_) ? 1 : -1;
+    framerate_control_.last_movie_frame_ = current_frame;
+  }
+  if (!framerate_control_.manualFrameControl) framerate_control_.movie_direction_ = 1;
+
+  const auto prefetch_frames = getConfig()["PrefetchFrames"].get<uint32_t>();
+  scene_->visManager->data().positions.prefetch(current_frame, framerate_control_.movie_direction_, prefetch_frames);
+  if (scene_->visManager->isBondsLoaded()) {
+    scene_->visManager->data().prefetchBonds(current_frame, framerate_control_.movie_direction_, prefetch_frames);
+  }
+}
+
 void Engine::unloadExperiment(){
   assert(scene_->visManager!=nullptr && "vis manager must be initialized, i.e. a database must be connected before unloading an experiment");
   scene_->visManager->unload();
   experiment_state_ = eNone;
+  experiment_pending_ = false;
 }
 
 void Engine::connectToDB(){
@@ -984,8 +1598,9 @@ void Engine::connectToDB(){
 
 void Engine::disconnectFromDB(){
 
-  // just kill the vis manager
+  // just kill the vis manager, a load that is still running is cancelled
   scene_->visManager.reset(nullptr);
+  experiment_pending_ = false;
   // reset ui per db state
   ui->loadedSettings.clear();
   ui->loadedEventsText.clear();
@@ -999,6 +1614,7 @@ void glfw_scroll_callback(GLFWwindow *, double /*x_offset*/, double y_offset) {
 }
 
 void Engine::scrollCallback(double y_offset) {
+  idle_.input_events++;
   if (ui->wantMouse()) return;
 
   const auto zoom_speed = camera_->isometric_view_settings_.zoom_speed;
@@ -1027,6 +1643,7 @@ void Engine::cleanupSelectAndTagMode() {
 }
 
 void Engine::keyCallback(int key, int /*scancode*/, int action, int /*mods*/) {
+  idle_.input_events++;
   if (ui->wantKeyboard()) return;
   if (key==GLFW_KEY_ESCAPE && action==GLFW_PRESS) {
 
@@ -1047,7 +1664,7 @@ void Engine::initGlfwCallbacks() {
   glfwSetScrollCallback(window_->glfwWindow_, glfw_scroll_callback);
 }
 
-void Engine::writeCameraBuffer() {
+void Engine::updateCamera() {
   camera_->system_center = getCenterCoords();
 
   //use the average frame time for camera updates to avoid camera jumps on lag frames
@@ -1056,7 +1673,63 @@ void Engine::writeCameraBuffer() {
   }
   auto cylinderType = reinterpret_cast<CylinderType *>(&(*scene_)["Cylinder"]);
   cylinderType->camera_view_direction = camera_->view_direction_;
+}
+
+Engine::RenderState Engine::currentRenderState() const {
+  const vk::Extent2D window_extent{static_cast<uint32_t>(window_->width()), static_cast<uint32_t>(window_->height())};
+  RenderState state{};
+  state.objects.experiment_id = scene_->visManager->getActiveExperiment();
+  state.objects.movie_frame = GetMovieFrameIndex();
+  state.objects.tags_version = scene_->visManager->tagsVersion();
+  state.objects.settings_version = scene_->settingsVersion();
+  state.objects.selected_object = selected_object_index_;
+  state.objects.bonds_loaded = scene_->visManager->isBondsLoaded();
+  state.objects.trajectory_uploaded = trajectory_uploaded_;
+  state.view.view = camera_->GetViewMatrix();
+  state.view.projection = camera_->GetProjectionMatrix(window_extent);
+  state.view.culling_enabled = isCullingEnabled;
+  state.view.occlusion_culling_enabled = occlusion_culling_enabled_;
+  state.view.impostor_rendering = impostor_rendering_;
+  return state;
+}
 
+bool Engine::waitForInputIfIdle() {
+  if (!idle_.enabled) return false;
+
+  // the callbacks count clicks, keys and scrolling, cursor moves and resizes are checked here
+  double cursor_x, cursor_y;
+  glfwGetCursorPos(window_->glfwWindow_, &cursor_x, &cursor_y);
+  const bool has_input = idle_.input_events!=idle_.seen_input_events
+      || cursor_x!=idle_.cursor_x || cursor_y!=idle_.cursor_y
+      || window_->width()!=idle_.width || window_->height()!=idle_.height;
+  idle_.seen_input_events = idle_.input_events;
+  idle_.cursor_x = cursor_x;
+  idle_.cursor_y = cursor_y;
+  idle_.width = window_->width();
+  idle_.height = window_->height();
+
+  // a running movie changes the shown frame without input, unless it stopped at its last frame
+  const bool is_playing = experiment_state_!=State::eNone && !framerate_control_.manualFrameControl
+      && scene_->MovieFrameCount() > 1
+      && (framerate_control_.isSimulationLooped
+          || framerate_control_.movie_frame_index_ < static_cast<float>(scene_->MovieFrameCount() - 1));
+  const bool is_busy = experiment_pending_ || bReadMousePickingBuffer_ || is_playing
+      || (scene_->visManager && scene_->visManager->isLoading());
+  if (has_input || is_busy) {
+    idle_.unchanged_frames = 0;
+    return false;
+  }
+
+  // the gui needs a frame to react to the last input and every frame in flight has to show the final state
+  if (idle_.unchanged_frames < FRAMES_IN_FLIGHT + 2) return false;
+
+  glfwWaitEventsTimeout(0.5);
+  // the time spent waiting is no frame time, it would make the camera jump on the next update
+  framerate_control_.currentTime = std::chrono::high_resolution_clock::now();
+  return true;
+}
+
+void Engine::writeCameraBuffer() {
   GPUCamData ubo{};
   const vk::Extent2D window_extent{static_cast<uint32_t>(window_->width()), static_cast<uint32_t>(window_->height())};
   ubo.viewMat = camera_->GetViewMatrix();
@@ -1067,7 +1740,7 @@ void Engine::writeCameraBuffer() {
                                              : glm::vec4(camera_->GetPosition(), 1.f);
   ubo.direction_of_light = glm::vec4(-camera_->view_direction_, 1.f);//glm::vec4(camera_->GetUp(), 1.f);
 
-  resource_manager_->writeToBuffer(getCurrentFrame().cam_buffer, &ubo, sizeof(GPUCamData));
+  getCurrentFrame().transient.camera = transient_allocator_.push(&ubo, sizeof(GPUCamData));
 }
 
 void Engine::writeSceneBuffer() {
@@ -1080,8 +1753,7 @@ void Engine::writeSceneBuffer() {
   scene_data_.pointLights[0].lightColor = glm::vec4(1.f, 1.f, 1.f, 50.f);
   scene_data_.ambientColor = glm::vec4(1.f, 1.f, 1.f, 0.02f);
 
-  scene_data_buffer_.descriptor_buffer_info_.offset = paddedUniformBufferSize(sizeof(GPUSceneData))*getCurrentFrameIndex();
-  resource_manager_->writeToBuffer(scene_data_buffer_, &scene_data_, sizeof(GPUSceneData));
+  getCurrentFrame().transient.scene = transient_allocator_.push(&scene_data_, sizeof(GPUSceneData));
 }
 
 void Engine::writeCullBuffer() {
@@ -1093,6 +1765,7 @@ void Engine::writeCullBuffer() {
   GPUCullData cullData = {};
 
   cullData.viewMatrix = camera_->GetViewMatrix();
+  cullData.projectionMatrix = camera_->GetProjectionMatrix(window_extent);
 
   //normal culling
   cullData.frustumNormalEquations[0] = normalizePlane(projectionT[3] + projectionT[0]);
@@ -1104,6 +1777,8 @@ void Engine::writeCullBuffer() {
   cullData.uniqueObjectCount = scene_->uniqueShownObjectCount(GetMovieFrameIndex());
   cullData.offsetCount = scene_->gConfig.xCellCount*scene_->gConfig.yCellCount*scene_->gConfig.zCellCount;
   cullData.isCullingEnabled = isCullingEnabled;
+  cullData.lodScale = std::abs(cullData.projectionMatrix[1][1])*static_cast<float>(window_extent.height)/2.f;
+  cullData.lodErrorThreshold = lod_error_threshold_;
 
   //cylinder culling
   if (scene_->visManager->data().activeEvent!=nullptr) {
@@ -1120,25 +1795,60 @@ void Engine::writeCullBuffer() {
     cullData.cullCylinder = false;
   }
 
-  resource_manager_->writeToBuffer(getCurrentFrame().cull_data_buffer, &cullData, sizeof(GPUCullData));
+  getCurrentFrame().transient.cull = transient_allocator_.push(&cullData, sizeof(GPUCullData));
+}
+
+Engine::DrawCallLayout Engine::currentDrawCallLayout() const {
+  DrawCallLayout layout;
+  layout.impostors = impostor_rendering_;
+  for (const auto &type : scene_->objectTypes) layout.max_counts[type->mesh_id] = type->MaxCount();
+  return layout;
 }
 
 void Engine::writeClearDrawCallBuffer() {
+  // the impostor draw groups need their pipelines before the next frame draws them
+  if (impostor_rendering_ && !atom_impostor_pipeline_) initImpostorPipelines();
 
-    GPUDrawCalls draws;
-  uint32_t previousFirstInstance = 0;
-  uint32_t previousMaxObjectCount = 0;
+    GPUDrawCalls draws{};
+  uint32_t firstInstance = 0;
   for (const auto &type : scene_->objectTypes) {
-    draws.commands[type->mesh_id].indexCount = meshes.meshInfos[type->mesh_id].indexCount;
-    draws.commands[type->mesh_id].firstIndex = meshes.meshInfos[type->mesh_id].firstIndex;
-    draws.commands[type->mesh_id].vertexOffset = meshes.meshInfos[type->mesh_id].firstVertex;
-    draws.commands[type->mesh_id].instanceCount = 0;
-    draws.commands[type->mesh_id].firstInstance = previousFirstInstance + 27*previousMaxObjectCount;
-
-    previousFirstInstance = draws.commands[type->mesh_id].firstInstance;
-    previousMaxObjectCount = type->MaxCount();
+    // impostors keep the draw command of their type, only the geometry it draws changes
+    meshID drawn_mesh = type->mesh_id;
+    if (impostor_rendering_ && type->mesh_id==meshID::eAtom) drawn_mesh = meshID::eImpostorQuad;
+    if (impostor_rendering_ && type->mesh_id==meshID::eBond) drawn_mesh = meshID::eImpostorBox;
+    const auto &mesh_info = meshes.meshInfos[drawn_mesh];
+
+    // the pipeline all levels of this type are drawn with
+    DrawGroup group = eDrawGroupMesh;
+    if (type->mesh_id==meshID::eAtom && impostor_rendering_) group = eDrawGroupAtomImpostor;
+    if (type->mesh_id==meshID::eBond) group = impostor_rendering_ ? eDrawGroupBondImpostor : eDrawGroupBond;
+
+    // meshes without detail levels only use the first one, the culling shader never picks the others
+    std::vector<MeshLod> lods = mesh_info.lods;
+    if (lods.empty()) lods.push_back({mesh_info.firstIndex, mesh_info.indexCount, 0.f});
+    // every object can be drawn once per periodic image in either level of a range
+    const auto level_count = static_cast<uint32_t>(std::min<size_t>(lods.size(), RCC_LOD_COUNT));
+    LodInstanceRange ranges[RCC_LOD_COUNT];
+    firstInstance = assignLodInstanceRanges(firstInstance, 27*type->MaxCount(), level_count, ranges);
+    for (uint32_t lod = 0; lod < RCC_LOD_COUNT; lod++) {
+      auto &command = draws.commands[type->mesh_id*RCC_LOD_COUNT + lod];
+      draws.drawGroups[type->mesh_id*RCC_LOD_COUNT + lod] = group;
+      draw_groups_[type->mesh_id*RCC_LOD_COUNT + lod] = group;
+      // infinite, not the largest float. times a zero radius that would pass the threshold and pick an empty level
+      draws.lodErrors[type->mesh_id][lod] = lod < level_count ? lods[lod].error : std::numeric_limits<float>::infinity();
+      if (lod >= level_count) continue;
+
+      command.firstInstance = ranges[lod].firstInstance;
+      draws.lodRangeEnds[type->mesh_id*RCC_LOD_COUNT + lod] = ranges[lod].rangeEnd;
+      command.indexCount = lods[lod].indexCount;
+      command.firstIndex = lods[lod].firstIndex;
+      command.vertexOffset = mesh_info.firstVertex;
+      command.instanceCount = 0;
+    }
   }
-  resource_manager_->stageBuffer(&draws, sizeof(GPUDrawCalls), clear_draw_call_buffer_, upload_context_, graphics_queue_);
+  // the callers wait until no frame is in flight, the next one waits for the copy
+  resource_manager_->stageBufferAsync(&draws, sizeof(GPUDrawCalls), clear_draw_call_buffer_);
+  written_draw_call_layout_ = currentDrawCallLayout();
 }
 
 GPUOffsets Engine::getOffsets() {
@@ -1182,7 +1892,18 @@ GPUOffsets Engine::getOffsets() {
 
 void Engine::writeOffsetBuffer() {
   auto gpu_offsets = getOffsets();
-  resource_manager_->writeToBuffer(getCurrentFrame().offset_buffer, &gpu_offsets, sizeof(GPUOffsets));
+  getCurrentFrame().transient.offsets = transient_allocator_.push(&gpu_offsets, sizeof(GPUOffsets));
+}
+
+void Engine::writeTransientData() {
+  // the slices of the last use of this frame are free again once its fence signaled. everything is written
+  // every frame, front to back, so the write combined memory sees one contiguous stream
+  transient_allocator_.beginFrame(getCurrentFrameIndex());
+  writeIndirectDispatchBuffer();
+  writeOffsetBuffer();
+  writeCameraBuffer();
+  writeSceneBuffer();
+  writeCullBuffer();
 }
 
 void Engine::writeObjectAndInstanceBuffer() {
@@ -1191,6 +1912,119 @@ void Engine::writeObjectAndInstanceBuffer() {
     scene_->writeObjectAndInstanceBuffer(objectSSBO, instanceSSBO, GetMovieFrameIndex(), selected_object_index_);
 }
 
+void Engine::writeExpandBuffers() {
+  static_assert(sizeof(GPUBond)==sizeof(Bond), "GPUBond has to match the layout of Bond");
+  auto &frame = getCurrentFrame();
+  const auto movie_frame = static_cast<uint32_t>(GetMovieFrameIndex());
+  const auto &data = scene_->visManager->data();
+
+  // the few remaining objects (unit cell, vectors, cylinder) are still written here
+  auto *objectSSBO = (GPUObjectData *) resource_manager_->getMappedData(frame.object_buffer.handle_);
+  auto *instanceSSBO = (GPUInstance *) resource_manager_->getMappedData(frame.instance_buffer.handle_);
+  scene_->writeObjectAndInstanceBuffer(objectSSBO, instanceSSBO, movie_frame, selected_object_index_, true);
+
+  GPUExpandData expand_data{};
+  scene_->writeExpandData(expand_data, movie_frame);
+  // a resident trajectory is indexed by the movie frame instead of uploading the frame
+  if (trajectory_uploaded_) expand_data.positionOffset = static_cast<uint32_t>(movie_frame*data.positions.frameStride());
+  resource_manager_->writeToBuffer(frame.expand_data_buffer, &expand_data, sizeof(GPUExpandData));
+
+  // positions, tags and bonds are only uploaded if this frame's buffers hold something else
+  if (!trajectory_uploaded_ && frame.written_movie_frame!=movie_frame) {
+    resource_manager_->writeToBuffer(frame.position_buffer, data.positions[movie_frame].data(),
+                                     sizeof(float)*data.positions.frameStride());
+    frame.written_movie_frame = movie_frame;
+  }
+  if (frame.written_tags_version!=scene_->visManager->tagsVersion()) {
+    resource_manager_->writeToBuffer(frame.atom_tag_buffer, data.tags.data(), sizeof(uint32_t)*data.tags.size());
+    frame.written_tags_version = scene_->visManager->tagsVersion();
+  }
+  if (expand_data.bondCount > 0 && frame.written_bond_frame!=movie_frame) {
+    resource_manager_->writeToBuffer(frame.bond_buffer, data.frameBonds(movie_frame).data(),
+                                     sizeof(GPUBond)*expand_data.bondCount);
+    frame.written_bond_frame = movie_frame;
+  }
+}
+
+void Engine::uploadTrajectory() {
+  const auto &positions = scene_->visManager->data().positions;
+  const vk::DeviceSize frame_size = sizeof(float)*positions.frameStride();
+  const vk::DeviceSize trajectory_size = frame_size*positions.size();
+
+  // only keep trajectories that leave enough room for everything else, otherwise stay with the per frame upload
+  vk::DeviceSize device_local_memory = 0;
+  for (const auto &heap : physical_device_.getMemoryProperties().memoryHeaps) {
+    if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) device_local_memory = std::max(device_local_memory, heap.size);
+  }
+  trajectory_checked_ = true;
+  if (trajectory_size==0 || trajectory_size > device_local_memory/2
+      || trajectory_size > gpu_properties_.limits.maxStorageBufferRange) {
+    return;
+  }
+
+  auto trajectory_buffer_handle = resource_manager_->createBuffer(
+      trajectory_size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  trajectory_buffer_ = resource_manager_->createBufferResource(
+      trajectory_buffer_handle, 0, trajectory_size, vk::DescriptorType::eStorageBuffer);
+
+  // finishTrajectoryUpload stages it piece by piece, the frames upload their positions until the buffer is bound
+  trajectory_upload_cursor_ = 0;
+  trajectory_upload_pending_ = true;
+}
+
+void Engine::finishTrajectoryUpload() {
+  if (!trajectory_upload_pending_) return;
+
+  // staged in one go the trajectory would fill the staging ring and block this thread, and the next frame
+  // would wait for the whole copy. one piece per frame keeps both bounded
+  const vk::DeviceSize trajectory_size = trajectory_buffer_.descriptor_buffer_info_.range;
+  if (trajectory_upload_cursor_ < trajectory_size) {
+    const vk::DeviceSize piece = std::min<vk::DeviceSize>(TRAJECTORY_UPLOAD_PER_FRAME,
+                                                          trajectory_size - trajectory_upload_cursor_);
+    const auto *positions = reinterpret_cast<const char *>(scene_->visManager->data().positions.data());
+    const auto destination = resource_manager_->createBufferResource(
+        trajectory_buffer_.handle_, trajectory_upload_cursor_, piece, vk::DescriptorType::eStorageBuffer);
+    trajectory_upload_token_ = resource_manager_->stageBufferAsync(positions + trajectory_upload_cursor_, piece,
+                                                                   destination);
+    trajectory_upload_cursor_ += piece;
+    return;
+  }
+  if (!resource_manager_->isUploadComplete(trajectory_upload_token_)) return;
+  trajectory_upload_pending_ = false;
+  bindExpandPositions(true);
+  trajectory_uploaded_ = true;
+}
+
+void Engine::releaseTrajectory() {
+  if (trajectory_upload_pending_) {
+    resource_manager_->waitForUpload(trajectory_upload_token_);
+    trajectory_upload_pending_ = false;
+    resource_manager_->destroyBuffer(trajectory_buffer_.handle_);
+    trajectory_buffer_ = BufferResource{};
+  }
+  if (trajectory_uploaded_) {
+    bindExpandPositions(false);
+    resource_manager_->destroyBuffer(trajectory_buffer_.handle_);
+    trajectory_buffer_ = BufferResource{};
+  }
+  trajectory_uploaded_ = false;
+  trajectory_checked_ = false;
+  trajectory_upload_cursor_ = 0;
+}
+
+void Engine::bindExpandPositions(bool resident) {
+  // the sets may still be used by frames in flight
+  logical_device_.waitIdle();
+  for (auto &frame : frame_data_) {
+    const auto &positions = resident ? trajectory_buffer_ : frame.position_buffer;
+    vk::WriteDescriptorSet write{frame.expand_compute_set, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr,
+                                 &positions.descriptor_buffer_info_};
+    logical_device_.updateDescriptorSets(write, nullptr);
+    frame.written_movie_frame = -1;
+  }
+}
+
 nlohmann::json &Engine::getConfig() {
   static nlohmann::json config;
   return config;
@@ -1221,17 +2055,53 @@ void Engine::initComputePipelines() {
   std::string cull_compute_module_path =
       getConfig()["AssetDirectoryFilepath"].get<std::string>() + getConfig()["CullShaderFilepath"].get<std::string>();
 
+  // set 0 holds the buffers of the frame, set 1 the depth pyramid. the push constant selects the CullPhase
+  const std::array<vk::DescriptorSetLayout, 2> cull_set_layouts{culling_descriptor_set_layout,
+                                                                depth_pyramid_descriptor_set_layout};
+  const vk::PushConstantRange cull_push_constant_range{vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t)};
   auto compute_pipeline_layout_info = vk::PipelineLayoutCreateInfo{
-      vk::PipelineLayoutCreateFlags(), culling_descriptor_set_layout, nullptr};
+      vk::PipelineLayoutCreateFlags(), cull_set_layouts, cull_push_constant_range};
   culling_compute_pipeline_layout_ = logical_device_.createPipelineLayout(compute_pipeline_layout_info);
   culling_compute_pipeline_ = createComputePipeline(cull_compute_module_path, culling_compute_pipeline_layout_);
+  std::string cluster_cull_compute_module_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+      + getConfig()["ClusterCullShaderFilepath"].get<std::string>();
+  cluster_culling_compute_pipeline_ =
+      createComputePipeline(cluster_cull_compute_module_path, culling_compute_pipeline_layout_);
+  if (draw_indirect_count_supported_) {
+    std::string compact_draws_module_path = getConfig()["AssetDirectoryFilepath"].get<std::string>()
+        + getConfig()["CompactDrawsShaderFilepath"].get<std::string>();
+    compact_draws_compute_pipeline_ =
+        createComputePipeline(compact_draws_module_path, culling_compute_pipeline_layout_);
+  }
+
+  // the pipeline itself is created in render when occlusion culling is used for the first time
+  const vk::PushConstantRange reduce_push_constant_range{vk::ShaderStageFlagBits::eCompute, 0,
+                                                         sizeof(GPUDepthReduceConstants)};
+  auto reduce_pipeline_layout_info = vk::PipelineLayoutCreateInfo{
+      vk::PipelineLayoutCreateFlags(), depth_reduce_descriptor_set_layout, reduce_push_constant_range};
+  depth_reduce_pipeline_layout_ = logical_device_.createPipelineLayout(reduce_pipeline_layout_info);
+
+  if (gpu_object_expansion_) {
+    std::string expand_compute_module_path =
+        getConfig()["AssetDirectoryFilepath"].get<std::string>() + getConfig()["ExpandShaderFilepath"].get<std::string>();
+    auto expand_pipeline_layout_info = vk::PipelineLayoutCreateInfo{
+        vk::PipelineLayoutCreateFlags(), expand_descriptor_set_layout, nullptr};
+    expand_compute_pipeline_layout_ = logical_device_.createPipelineLayout(expand_pipeline_layout_info);
+    expand_compute_pipeline_ = createComputePipeline(expand_compute_module_path, expand_compute_pipeline_layout_);
+  }
 
   main_destruction_stack_.push([=]() {
 #ifdef RCC_DESTROY_MESSAGES
     std::cout << "Destroying compute pipeline and layout\n";
 #endif
+    logical_device_.destroy(cluster_culling_compute_pipeline_);
+    if (depth_reduce_compute_pipeline_) logical_device_.destroy(depth_reduce_compute_pipeline_);
+    logical_device_.destroy(depth_reduce_pipeline_layout_);
     logical_device_.destroy(culling_compute_pipeline_);
+    if (compact_draws_compute_pipeline_) logical_device_.destroy(compact_draws_compute_pipeline_);
     logical_device_.destroy(culling_compute_pipeline_layout_);
+    if (expand_compute_pipeline_) logical_device_.destroy(expand_compute_pipeline_);
+    if (expand_compute_pipeline_layout_) logical_device_.destroy(expand_compute_pipeline_layout_);
   });
 }
 
@@ -1261,9 +2131,10 @@ void Engine::resetDrawData(vk::CommandBuffer &cmd,
 }
 
 void Engine::writeIndirectDispatchBuffer() {
-  uint32_t group_count = ceil(scene_->uniqueShownObjectCount(GetMovieFrameIndex())/256.0);
+  // one workgroup per cluster, see cull_clusters.comp
+  uint32_t group_count = ceil(scene_->uniqueShownObjectCount(GetMovieFrameIndex())/static_cast<double>(RCC_CLUSTER_SIZE));
   vk::DispatchIndirectCommand command{group_count, 1, 1};
-  resource_manager_->writeToBuffer(indirect_dispatch_buffer_, &command, sizeof(vk::DispatchIndirectCommand));
+  getCurrentFrame().transient.dispatch = transient_allocator_.push(&command, sizeof(vk::DispatchIndirectCommand));
 }
 
 void Engine::enterEventMode(int eventID) {
@@ -1369,6 +2240,7 @@ void Engine::DumpSettingsJson(const std::string &filepath) {
   getConfig()["BondThickness"] = scene_->gConfig.bondThickness;
   getConfig()["HinumaLength"] = scene_->gConfig.hinumaVectorLength;
   getConfig()["HinumaThickness"] = scene_->gConfig.hinumaVectorThickness;
+  getConfig()["ImpostorRendering"] = impostor_rendering_;
   getConfig()["BoxCountX"] = scene_->gConfig.xCellCount;
   getConfig()["BoxCountY"] = scene_->gConfig.yCellCount;
   getConfig()["BoxCountZ"] = scene_->gConfig.zCellCount;
@@ -1422,7 +2294,7 @@ void Engine::selectAtomsWithRect(glm::vec2 start, glm::vec2 end, int frame_index
   frustumNormalEquations[5] = normalizePlane(projT[3] - projT[2]);
 
   // cpu culling :(((
-  const Eigen::MatrixX3f &positions = scene_->visManager->data().positions[frame_index];
+  const auto positions = scene_->visManager->data().positions[frame_index];
   GPUOffsets mic_offsets = getOffsets();
 
   for (int i = 0; i < scene_->visManager->data().positions[frame_index].rows(); i++) {
@@ -0,0 +1,126 @@
+#include "frame_provider.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rcc {
+
+FrameProvider::~FrameProvider() {
+  clear();
+}
+
+void FrameProvider::clear() {
+  if (mapping_) {
+    munmap(mapping_, mappingSize_);
+    mapping_ = nullptr;
+    mappingSize_ = 0;
+  }
+  memory_.clear();
+  memory_.shrink_to_fit();
+  data_ = nullptr;
+  isWritable_ = false;
+  frameCount_ = 0;
+  atomCount_ = 0;
+  residentBegin_ = residentEnd_ = 0;
+}
+
+void FrameProvider::allocate(const uint32_t frameCount, const uint32_t atomCount, const std::string &backingFilepath) {
+  clear();
+  frameCount_ = frameCount;
+  atomCount_ = atomCount;
+  isWritable_ = true;
+  const size_t floatCount = size_t{frameCount}*atomCount*3;
+
+  if (!backingFilepath.empty() && floatCount > 0) {
+    const int fd = open(backingFilepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd!=-1) {
+      unlink(backingFilepath.c_str());
+      if (ftruncate(fd, static_cast<off_t>(floatCount*sizeof(float)))==0) {
+        void *mapping = mmap(nullptr, floatCount*sizeof(float), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping!=MAP_FAILED) {
+          mapping_ = mapping;
+          mappingSize_ = floatCount*sizeof(float);
+          data_ = static_cast<float *>(mapping);
+        }
+      }
+      close(fd);
+    }
+    if (!mapping_) {
+      std::cerr << "Could not create frame backing file " << backingFilepath << ", keeping frames in memory\n";
+    }
+  }
+
+  if (!mapping_) {
+    memory_.resize(floatCount);
+    data_ = memory_.data();
+  }
+}
+
+bool FrameProvider::map(const std::string &filepath, const uint64_t offset, const uint32_t frameCount,
+                        const uint32_t atomCount) {
+  const int fd = open(filepath.c_str(), O_RDONLY);
+  if (fd==-1) return false;
+  struct stat fileStat{};
+  const size_t floatCount = size_t{frameCount}*atomCount*3;
+  if (fstat(fd, &fileStat)!=0 || offset + floatCount*sizeof(float) > static_cast<uint64_t>(fileStat.st_size)
+      || offset%sizeof(float)!=0) {
+    close(fd);
+    return false;
+  }
+  // mmap offsets must be page aligned, so the whole file is mapped and the frames start inside of it
+  void *mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping==MAP_FAILED) return false;
+
+  clear();
+  mapping_ = mapping;
+  mappingSize_ = static_cast<size_t>(fileStat.st_size);
+  data_ = reinterpret_cast<float *>(static_cast<char *>(mapping) + offset);
+  frameCount_ = frameCount;
+  atomCount_ = atomCount;
+  madvise(mapping_, mappingSize_, MADV_RANDOM);
+  return true;
+}
+
+void FrameProvider::adviseFrames(const uint32_t first, const uint32_t last, const int advice) const {
+  if (first >= last) return;
+  const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto begin = reinterpret_cast<uintptr_t>(data_ + first*frameStride());
+  auto end = reinterpret_cast<uintptr_t>(data_ + last*frameStride());
+  const auto mappingBegin = reinterpret_cast<uintptr_t>(mapping_);
+  if (advice==MADV_DONTNEED) {
+    // only release pages that are completely inside of the range, the neighbors might still be needed
+    begin = (begin + pageSize - 1)/pageSize*pageSize;
+    end = end/pageSize*pageSize;
+  } else {
+    begin = std::max(begin/pageSize*pageSize, mappingBegin);
+  }
+  if (begin >= end) return;
+  madvise(reinterpret_cast<void *>(begin), end - begin, advice);
+}
+
+void FrameProvider::prefetch(const uint32_t frameIndex, const int direction, const uint32_t window) const {
+  if (!mapping_ || frameCount_==0) return;
+
+  uint32_t begin, end;
+  if (direction < 0) {
+    begin = frameIndex - std::min(frameIndex, window);
+    end = frameIndex + 1;
+  } else {
+    begin = frameIndex;
+    end = std::min(frameCount_, frameIndex + window + 1);
+  }
+  if (begin==residentBegin_ && end==residentEnd_) return;
+
+  // frames of the last window that are not part of the new one
+  adviseFrames(residentBegin_, std::min(residentEnd_, begin), MADV_DONTNEED);
+  adviseFrames(std::max(residentBegin_, end), residentEnd_, MADV_DONTNEED);
+  adviseFrames(begin, end, MADV_WILLNEED);
+  residentBegin_ = begin;
+  residentEnd_ = end;
+}
+
+} // namespace rcc
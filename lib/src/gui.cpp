@@ -79,6 +79,9 @@ void UserInterface::showMainMenubar() {
       ImGui::SliderFloat("Hinuma Vector Length", &parentEngine->scene_->gConfig.hinumaVectorLength, 0, 2);
       ImGui::SliderFloat("Hinuma Vector Thickness", &parentEngine->scene_->gConfig.hinumaVectorThickness, 0, 4);
 
+      ImGui::Separator();
+      ImGui::Checkbox("Ray Cast Atoms and Bonds", &parentEngine->impostor_rendering_);
+
       ImGui::EndMenu();
     }
 
@@ -136,7 +139,8 @@ void UserInterface::showEventsTable(int experimentID) {
       }
       ImGui::TableNextColumn();
       ImGui::PushID(j);
-      if (ImGui::SmallButton("jump")) {
+      // events change tags and need all frames, so they are available once loading has finished
+      if (!parentEngine->scene_->visManager->isLoading() && ImGui::SmallButton("jump")) {
         parentEngine->enterEventMode(std::get<0>(events[j]));
       }
       ImGui::PopID();
@@ -228,6 +232,30 @@ void UserInterface::showSettingTable(int settingID) {
   }
 }
 
+void UserInterface::showLoadProgress() {
+  const VisDataManager &manager = *parentEngine->scene_->visManager;
+  const uint32_t loadedFrames = manager.loadedFrameCount();
+  const uint32_t totalFrames = manager.totalFrameCount();
+  float progress = 0.f;
+  std::string label;
+  switch (manager.loadStage()) {
+    case LoadStage::eTopology:
+      label = "Reading system";
+      break;
+    case LoadStage::eFrames:
+      progress = (totalFrames > 0) ? static_cast<float>(loadedFrames)/static_cast<float>(totalFrames) : 0.f;
+      label = "Reading frames " + std::to_string(loadedFrames) + "/" + std::to_string(totalFrames);
+      break;
+    case LoadStage::eBonds:
+      progress = 1.f;
+      label = "Creating bonds";
+      break;
+    default:
+      return;
+  }
+  ImGui::ProgressBar(progress, {-1.f, 0.f}, label.c_str());
+}
+
 void UserInterface::showLeftAlignedWindow() {
   {
     float width = static_cast<float>(parentEngine->window_->width())*leftAlignedWidgetRelativeSize;
@@ -244,6 +272,8 @@ void UserInterface::showLeftAlignedWindow() {
           experimentsNeedRefresh = false;
         }
         ImGui::Text("Experiments:");
+        const bool isLoading = parentEngine->scene_->visManager->isLoading();
+        if (isLoading) showLoadProgress();
         for (int i = 0; i < experiments_.experimentSystemSettingIDs.size(); i++) {
           ImGui::PushID(i);
 
@@ -256,7 +286,7 @@ void UserInterface::showLeftAlignedWindow() {
                                                                        : "Experiment  (ID=%d)",
                                                     experimentID);
 
-          if (!isActiveExperiment) {
+          if (!isActiveExperiment && !isLoading) {
             ImGui::SameLine();
             if (ImGui::SmallButton("load")) {
               parentEngine->loadExperiment(experimentID);
@@ -342,6 +372,7 @@ void UserInterface::showInfoWindow() {
 #endif
 #ifdef RCC_GUI_DEV_MODE
       ImGui::Checkbox("Enable Culling", &parentEngine->isCullingEnabled);
+      ImGui::Checkbox("Occlusion Culling", &parentEngine->occlusion_culling_enabled_);
 #endif
       if (parentEngine->experiment_state_ != eNone) {
         ImGui::SliderInt("Movie Framerate:", &parentEngine->framerate_control_.movie_framerate_, 1, 300);
@@ -355,7 +386,7 @@ void UserInterface::showInfoWindow() {
         ImGui::Checkbox("Manual Movie Frame Control", &parentEngine->framerate_control_.manualFrameControl);
         ImGui::Separator();
 
-        if(parentEngine->ui_mode_ == uiMode::eSelectAndTag) {
+        if(parentEngine->ui_mode_ == uiMode::eSelectAndTag && !parentEngine->scene_->visManager->isLoading()) {
           if (ImGui::Button("Remove Selection")) {
             parentEngine->scene_->visManager->removeSelectedByAreaTags();
           }
@@ -734,7 +765,8 @@ void UserInterface::show() {
   if (preferencesWindowVisible) showPreferencesWindow();
 
   // draw selection rectangle
-  if (!wantMouse() && parentEngine->camera_->is_isometric && parentEngine->ui_mode_ == uiMode::eSelectAndTag) {
+  if (!wantMouse() && parentEngine->camera_->is_isometric && parentEngine->ui_mode_ == uiMode::eSelectAndTag
+      && parentEngine->experiment_state_ != eNone && !parentEngine->scene_->visManager->isLoading()) {
     static ImVec2 start{0.0, 0.0};
     static ImVec2 end{0.0, 0.0};
 
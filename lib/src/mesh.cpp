@@ -6,6 +6,7 @@
 
 #include <string>
 #include <iostream>
+#include <algorithm>
 
 namespace rcc {
 VertexDescription BasicVertex::getDescription() {
@@ -217,6 +218,31 @@ void Mesh::createUnitCellMesh(const glm::mat3 &b) {
 
 }
 
+void Mesh::createImpostorQuad() {
+  for (float y : {-1.f, 1.f}) {
+    for (float x : {-1.f, 1.f}) {
+      vertices_.push_back({glm::vec3(x, y, 0.f), glm::vec3(0.f, 0.f, 1.f), glm::vec3(1.f)});
+    }
+  }
+  indices_ = {0, 1, 2, 2, 1, 3};
+  calcRadius();
+}
+
+void Mesh::createImpostorBox() {
+  // corner i has the coordinates of the bits of i, x in bit 0, y in bit 1 and z in bit 2
+  for (uint32_t i = 0; i < 8; i++) {
+    const glm::vec3 corner((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+    vertices_.push_back({corner, glm::normalize(corner), glm::vec3(1.f)});
+  }
+  indices_ = {0, 2, 1, 1, 2, 3,  // -z
+              4, 5, 6, 6, 5, 7,  // +z
+              0, 1, 4, 4, 1, 5,  // -y
+              2, 6, 3, 3, 6, 7,  // +y
+              0, 4, 2, 2, 4, 6,  // -x
+              1, 3, 5, 5, 3, 7}; // +x
+  calcRadius();
+}
+
 /*
 void Mesh::createFrustumMesh() {
 
@@ -413,6 +439,35 @@ void Mesh::optimizeMesh() {
                               sizeof(BasicVertex));
 }
 
+void Mesh::generateLods(uint32_t lod_count) {
+  const std::vector<uint32_t> full_indices = indices_;
+  const float *positions = &vertices_[0].position[0];
+  const float error_scale = meshopt_simplifyScale(positions, vertices_.size(), sizeof(BasicVertex)) / radius;
+
+  lods_.clear();
+  lods_.push_back({0, static_cast<uint32_t>(full_indices.size()), 0.f});
+  for (uint32_t lod = 1; lod < lod_count; lod++) {
+    const MeshLod previous = lods_.back();
+    const size_t target_index_count = std::max<size_t>(previous.indexCount/4/3*3, 3);
+
+    // no error limit, the culling shader picks the level by the projected error
+    std::vector<uint32_t> lod_indices(full_indices.size());
+    float error = 0.f;
+    lod_indices.resize(meshopt_simplify(lod_indices.data(), full_indices.data(), full_indices.size(),
+                                        positions, vertices_.size(), sizeof(BasicVertex),
+                                        target_index_count, 1.f, 0, &error));
+    if (lod_indices.empty() || lod_indices.size() >= previous.indexCount) {
+      lods_.push_back(previous);
+      continue;
+    }
+    meshopt_optimizeVertexCache(lod_indices.data(), lod_indices.data(), lod_indices.size(), vertices_.size());
+
+    lods_.push_back({static_cast<uint32_t>(indices_.size()), static_cast<uint32_t>(lod_indices.size()),
+                     std::max(error*error_scale, previous.error)});
+    indices_.insert(indices_.end(), lod_indices.begin(), lod_indices.end());
+  }
+}
+
 void Mesh::calcRadius() {
   radius = 0;
   for (const auto &v : vertices_) {
@@ -425,9 +480,11 @@ MeshMerger &MeshMerger::addMesh(const Mesh &mesh, meshID mesh_id, vk::Pipeline p
 
   // save meshInfos
   uint32_t firstIndex = accumulated_mesh_->indices_.size();
-  uint32_t indexCount = mesh.indices_.size();
+  uint32_t indexCount = mesh.lods_.empty() ? mesh.indices_.size() : mesh.lods_[0].indexCount;
   int32_t firstVertex = accumulated_mesh_->vertices_.size();
-  meshInfos.emplace(mesh_id, MeshInfo{pipeline, layout, firstIndex, indexCount, firstVertex, mesh.radius});
+  std::vector<MeshLod> lods = mesh.lods_;
+  for (auto &lod : lods) lod.firstIndex += firstIndex;
+  meshInfos.emplace(mesh_id, MeshInfo{pipeline, layout, firstIndex, indexCount, firstVertex, mesh.radius, lods});
 
   // insert new vertex and index data
   auto &vertex_dest = accumulated_mesh_->vertices_;
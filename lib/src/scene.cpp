@@ -4,12 +4,35 @@
 
 #include "scene.hpp"
 
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/vector_angle.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
 #include "engine.hpp"
 
+namespace {
+// atoms and bonds per task when writing the object buffer
+constexpr uint32_t kWriteGrainSize = 1024;
+// grid cells per axis for the spatial order of the atoms
+constexpr uint32_t kOrderGridSize = 1024;
+
+// interleaves the lower 10 bits of x, y and z
+uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+  const auto spread = [](uint32_t v) {
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  };
+  return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+}
+
 namespace rcc {
 
 Scene::Scene() {
@@ -46,7 +69,7 @@ Scene::~Scene() {
   }
 }
 
-inline glm::vec3 Scene::antiStutterOffset(uint32_t movieFrameIndex) const {
+glm::vec3 Scene::antiStutterOffset(uint32_t movieFrameIndex) const {
   if (visManager) {
     Eigen::Vector3f temp = (freezeAtomIndex==-1) ? Eigen::Vector3f::Zero() : Eigen::Vector3f(
         visManager->data().positions[0].row(freezeAtomIndex)
@@ -57,6 +80,21 @@ inline glm::vec3 Scene::antiStutterOffset(uint32_t movieFrameIndex) const {
   }
 }
 
+uint64_t Scene::settingsVersion() const {
+  Settings settings{gConfig, {}, colorByBaseType_,
+                    eventViewerSettings.cylinderLength, eventViewerSettings.cylinderRadius,
+                    eventViewerSettings.enableCylinderCulling, eventViewerSettings.surfaceNormals,
+                    visManager ? visManager->data().activeEvent.get() : nullptr, freezeAtomIndex};
+  for (int i = 0; i < RCC_MESH_COUNT; i++) {
+    settings.shown[i] = objectTypes[i]->shown;
+  }
+  if (!(settings==lastSettings_)) {
+    lastSettings_ = settings;
+    settingsVersion_++;
+  }
+  return settingsVersion_;
+}
+
 uint32_t Scene::uniqueShownObjectCount(uint32_t movieFrameIndex) const {
   uint32_t c = 0;
   for (const auto &type : objectTypes)
@@ -77,24 +115,68 @@ std::string Scene::getObjectInfo(uint32_t movieFrameIndex, uint32_t objectIndex)
   return "Could not find corresponding Object + Type";
 }
 
+std::array<uint32_t, RCC_MESH_COUNT> Scene::firstObjectIndices(uint32_t movieFrameIndex) const {
+  std::array<uint32_t, RCC_MESH_COUNT> first_indices{};
+  uint32_t object_index = 0;
+  for (int i = 0; i < RCC_MESH_COUNT; i++) {
+    first_indices[i] = object_index;
+    if (isWritten(static_cast<meshID>(i))) object_index += objectTypes[i]->Count(movieFrameIndex);
+  }
+  return first_indices;
+}
+
 void Scene::writeObjectAndInstanceBuffer(GPUObjectData *objectSSBO,
                                          GPUInstance *instanceSSBO,
                                          uint32_t movieFrameIndex,
-                                         uint32_t selectedObjectIndex) const {
-
-  const auto &atom_positions = visManager->data().positions[movieFrameIndex];
-  uint32_t object_index = 0;
-  for (const auto &type : objectTypes) {
-    if (type->isLoaded() && type->shown) {
-      type->writeToObjectBufferAndIndexBuffer(movieFrameIndex,
-                                              object_index,
-                                              selectedObjectIndex,
-                                              objectSSBO,
-                                              instanceSSBO);
-      object_index += type->Count(movieFrameIndex);
-    }
+                                         uint32_t selectedObjectIndex,
+                                         bool skipExpandedTypes) const {
+
+  updateElementTable();
+
+  // the object ranges of the types don't overlap, so every type can write its range on its own
+  const auto first_indices = firstObjectIndices(movieFrameIndex);
+  tbb::parallel_for(0, RCC_MESH_COUNT, [&](const int i) {
+    if (!isWritten(static_cast<meshID>(i))) return;
+    if (skipExpandedTypes && (i==meshID::eAtom || i==meshID::eBond)) return;
+    objectTypes[i]->writeToObjectBufferAndIndexBuffer(movieFrameIndex,
+                                                      first_indices[i],
+                                                      selectedObjectIndex,
+                                                      objectSSBO,
+                                                      instanceSSBO);
+  });
+}
+
+void Scene::writeExpandData(GPUExpandData &expandData, uint32_t movieFrameIndex) const {
+  updateElementTable();
+  const auto first_indices = firstObjectIndices(movieFrameIndex);
+
+  expandData.unitCell = glm::mat4(cellGLM());
+  expandData.antiStutterOffset = glm::vec4(antiStutterOffset(movieFrameIndex), 0.f);
+  expandData.catalystColor = gConfig.catalyst_color_;
+  expandData.chemicalColor = gConfig.chemical_color_;
+  for (int i = 0; i < 256; i++) {
+    expandData.elements[i] = glm::vec4(glm::vec3(element_table_.color[i]), element_table_.radius[i]);
+  }
+  expandData.atomCount = objectTypes[meshID::eAtom]->Count(movieFrameIndex);
+  expandData.shownAtomCount = isWritten(meshID::eAtom) ? expandData.atomCount : 0;
+  expandData.bondCount = isWritten(meshID::eBond) ? objectTypes[meshID::eBond]->Count(movieFrameIndex) : 0;
+  expandData.firstAtomObject = first_indices[meshID::eAtom];
+  expandData.firstBondObject = first_indices[meshID::eBond];
+  expandData.atomSize = gConfig.atomSize;
+  expandData.bondLength = gConfig.bondLength;
+  expandData.bondThickness = gConfig.bondThickness;
+  expandData.atomMeshRadius = meshes->meshInfos[meshID::eAtom].radius;
+  expandData.bondMeshRadius = meshes->meshInfos[meshID::eBond].radius;
+  expandData.colorByBaseType = colorByBaseType_;
+}
+
+void Scene::updateElementTable() const {
+  element_table_.radius.fill(0.f);
+  element_table_.color.fill(glm::vec4{1.f});
+  for (const auto &[elementNumber, elmInfo] : visManager->data().elementInfos) {
+    element_table_.radius[elementNumber & 255] = elmInfo.atomRadius;
+    element_table_.color[elementNumber & 255] = glm::vec4(elmInfo.color, 1.f);
   }
-
 }
 int Scene::tryPickFreezeAtom() const {
   size_t i1 = 0, i2 = (MovieFrameCount() - 1)/2, i3 = MovieFrameCount() - 1;
@@ -102,9 +184,9 @@ int Scene::tryPickFreezeAtom() const {
   // we need at least 3 frames with minimum two atoms
   if (visManager->data().positions.size() < 3 || objectTypes[meshID::eAtom]->Count(i1) < 2) { return -1; }
 
-  const Eigen::Matrix<float, Eigen::Dynamic, 3> &pos1 = visManager->data().positions[i1];
-  const Eigen::Matrix<float, Eigen::Dynamic, 3> &pos2 = visManager->data().positions[i2];
-  const Eigen::Matrix<float, Eigen::Dynamic, 3> &pos3 = visManager->data().positions[i3];
+  const auto pos1 = visManager->data().positions[i1];
+  const auto pos2 = visManager->data().positions[i2];
+  const auto pos3 = visManager->data().positions[i3];
 
   for (int i = 0; i < pos1.rows() - 1; i++) {
     if (((pos1.row(i) - pos1.row(i + 1))
@@ -163,13 +245,14 @@ uint32_t VectorType::Count(uint32_t movieFrameIndex) const {
 }
 
 uint32_t BondType::Count(uint32_t movieFrameIndex) const {
-  return s.visManager->data().bonds[movieFrameIndex].size();
+  if (!isLoaded()) return 0;
+  const auto &data = s.visManager->data();
+  return std::min(static_cast<uint32_t>(data.frameBonds(movieFrameIndex).size()), data.maxBondCount);
 }
 
 // MAX COUNTS
 uint32_t AtomType::MaxCount() const {
-  return std::max_element(s.visManager->data().positions.begin(), s.visManager->data().positions.end(),
-                          [](const auto &a, const auto &b) { return a.rows() < b.rows(); })->rows();
+  return s.visManager->data().positions.atomCount();
 }
 
 uint32_t UnitCellType::MaxCount() const {
@@ -185,9 +268,7 @@ uint32_t CylinderType::MaxCount() const {
 }
 
 uint32_t BondType::MaxCount() const {
-  const auto largestVectorElement = std::max_element(s.visManager->data().bonds.begin(), s.visManager->data().bonds.end(),
-                                                     [](const auto &a, const auto &b) { return a.size() < b.size(); });
-  return largestVectorElement->size();
+  return isLoaded() ? s.visManager->data().maxBondCount : 0;
 }
 
 // IS LOADED
@@ -196,7 +277,8 @@ bool AtomType::isLoaded() const {
 }
 
 bool BondType::isLoaded() const {
-  return !s.visManager->data().bonds.empty();
+  // bonds are created after all frames are read, the experiment is shown before that
+  return s.visManager->isBondsLoaded() && s.visManager->data().hasBonds();
 }
 
 bool VectorType::isLoaded() const {
@@ -210,6 +292,38 @@ bool UnitCellType::isLoaded() const {
 
 // WRITE BUFFER
 
+void Scene::updateAtomOrder(uint32_t movieFrameIndex, uint32_t atomCount) const {
+  const float *x = visManager->data().positions[movieFrameIndex].data();
+  const float *coordinates[3] = {x, x + atomCount, x + 2*atomCount};
+
+  float lower[3], scale[3];
+  for (int axis = 0; axis < 3; axis++) {
+    const auto [min, max] = std::minmax_element(coordinates[axis], coordinates[axis] + atomCount);
+    lower[axis] = (atomCount > 0) ? *min : 0.f;
+    const float extent = (atomCount > 0) ? *max - *min : 0.f;
+    scale[axis] = (extent > 0.f) ? (kOrderGridSize - 1)/extent : 0.f;
+  }
+
+  // morton code in the upper, atom index in the lower half, sorting the keys sorts the atoms by cell
+  atomOrderKeys_.resize(atomCount);
+  tbb::parallel_for(tbb::blocked_range<uint32_t>(0, atomCount, kWriteGrainSize),
+                    [&](const tbb::blocked_range<uint32_t> &range) {
+    for (uint32_t i = range.begin(); i < range.end(); i++) {
+      uint32_t cell[3];
+      for (int axis = 0; axis < 3; axis++) {
+        cell[axis] = static_cast<uint32_t>((coordinates[axis][i] - lower[axis])*scale[axis]);
+      }
+      atomOrderKeys_[i] = (uint64_t{mortonCode(cell[0], cell[1], cell[2])} << 32) | i;
+    }
+  });
+  tbb::parallel_sort(atomOrderKeys_.begin(), atomOrderKeys_.end());
+
+  atomOrder_.resize(atomCount);
+  for (uint32_t i = 0; i < atomCount; i++) {
+    atomOrder_[i] = static_cast<uint32_t>(atomOrderKeys_[i]);
+  }
+}
+
 //void AtomType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex, uint32_t firstIndex, uint32_t selectedObjectIndex, GPUObjectData * objectSSBO, GPUInstance* instanceSSBO) const {
 //  uint32_t object_index = firstIndex;
 //  const auto &atom_positions = s.visLoader->data().positions[movieFrameIndex];
@@ -242,24 +356,14 @@ bool UnitCellType::isLoaded() const {
 //}
 
 glm::vec4 Scene::getAtomColor(uint32_t tag) const {
-  // C++ syntax for calling a member function pointer pls
-  return (this ->* ((const rcc::Scene*)this)->rcc::Scene::current_atom_color_function)(tag);
-}
-
-glm::vec4 Scene::colorAtomByElementNumber(uint32_t tag) const {
-  if ((tag & Tags::eSelectedForMeasurement)==Tags::eSelectedForMeasurement) return {0.224f, 1.f, 0.078f, 1.f};
-  if ((tag & Tags::eSelectedForTagging)==Tags::eSelectedForTagging) return {0.7f, 0.72f, 0.95f, 1.f};
-  if ((tag & Tags::eHighlighted)==Tags::eHighlighted) return {0.83f, 0.1f, 0.7f, 1.f};
-  return {visManager->data().elementInfos.find((tag & 255))->second.color, 1.f};
-}
-
-glm::vec4 Scene::colorAtomByBaseType(uint32_t tag) const {
   if ((tag & Tags::eSelectedForMeasurement)==Tags::eSelectedForMeasurement) return {0.224f, 1.f, 0.078f, 1.f};
   if ((tag & Tags::eSelectedForTagging)==Tags::eSelectedForTagging) return {0.7f, 0.72f, 0.95f, 1.f};
   if ((tag & Tags::eHighlighted)==Tags::eHighlighted) return {0.83f, 0.1f, 0.7f, 1.f};
-  if ((tag & Tags::eCatalyst)==Tags::eCatalyst) return gConfig.catalyst_color_;
-  if ((tag & Tags::eChemical)==Tags::eChemical) return gConfig.chemical_color_;
-  return {visManager->data().elementInfos.find((tag & 255))->second.color, 1.f};
+  if (colorByBaseType_) {
+    if ((tag & Tags::eCatalyst)==Tags::eCatalyst) return gConfig.catalyst_color_;
+    if ((tag & Tags::eChemical)==Tags::eChemical) return gConfig.chemical_color_;
+  }
+  return element_table_.color[tag & 255];
 }
 
 void AtomType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
@@ -267,26 +371,43 @@ void AtomType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
                                                  uint32_t selectedObjectIndex,
                                                  GPUObjectData *objectSSBO,
                                                  GPUInstance *instanceSSBO) const {
-  uint32_t object_index = firstIndex;
-  const auto &atom_positions = s.visManager->data().positions[movieFrameIndex];
-  glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
-
-  for (int i = 0; i < atom_positions.rows(); i++) {
-    uint32_t element_number = (s.visManager->data().tags[object_index] & 255);
-    const float radius = s.visManager->data().elementInfos.find(element_number)->second.atomRadius;
-    const glm::vec3 pos =
-        glm::vec3{atom_positions(object_index, 0), atom_positions(object_index, 1), atom_positions(object_index, 2)}
-            + anti_stutter_offset;
-    const auto modelMatrix = glm::translate(glm::mat4{1.f}, pos);
-    objectSSBO[object_index].modelMatrix = glm::scale(modelMatrix, glm::vec3(radius*s.gConfig.atomSize));
-    objectSSBO[object_index].color1 = s.getAtomColor(s.visManager->data().tags[object_index]);
-    objectSSBO[object_index].radius = s.meshes->meshInfos[meshID::eAtom].radius*radius*s.gConfig.atomSize;
-    objectSSBO[object_index].batchID = meshID::eAtom;
-    instanceSSBO[object_index].object_id = object_index;
-    instanceSSBO[object_index].batch_id = meshID::eAtom;
-    object_index++;
-  }
-
+  const auto &data = s.visManager->data();
+  const auto atom_positions = data.positions[movieFrameIndex];
+  const uint32_t atomCount = Count(movieFrameIndex);
+  const glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
+  const float atomSize = s.gConfig.atomSize;
+  const float meshRadius = s.meshes->meshInfos[meshID::eAtom].radius;
+  const auto &radii = s.element_table_.radius;
+
+  // a frame stores all x, then all y, then all z coordinates
+  const float *x = atom_positions.data();
+  const float *y = x + atomCount;
+  const float *z = y + atomCount;
+  const uint32_t *tags = data.tags.data();
+  s.updateAtomOrder(movieFrameIndex, atomCount);
+  const uint32_t *order = s.atomOrder_.data();
+
+  tbb::parallel_for(tbb::blocked_range<uint32_t>(0, atomCount, kWriteGrainSize),
+                    [&](const tbb::blocked_range<uint32_t> &range) {
+    for (uint32_t i = range.begin(); i < range.end(); i++) {
+      const uint32_t tag = tags[i];
+      const float scale = radii[tag & 255]*atomSize;
+
+      // translate * scale without the matrix products
+      GPUObjectData object{};
+      object.modelMatrix = glm::mat4{scale};
+      object.modelMatrix[3] = glm::vec4{x[i] + anti_stutter_offset.x, y[i] + anti_stutter_offset.y,
+                                        z[i] + anti_stutter_offset.z, 1.f};
+      object.color1 = s.getAtomColor(tag);
+      object.radius = meshRadius*scale;
+      object.batchID = meshID::eAtom;
+
+      const uint32_t object_index = firstIndex + i;
+      objectSSBO[object_index] = object;
+      // the object index stays the atom index, only the instances are sorted spatially
+      instanceSSBO[object_index] = GPUInstance{firstIndex + order[i], meshID::eAtom};
+    }
+  });
 }
 
 void UnitCellType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
@@ -312,14 +433,14 @@ void VectorType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
                                                    GPUObjectData *objectSSBO,
                                                    GPUInstance *instanceSSBO) const {
   uint32_t object_index = firstIndex;
-  const auto &atom_positions = s.visManager->data().positions[movieFrameIndex];
+  const auto atom_positions = s.visManager->data().positions[movieFrameIndex];
   glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
 
   for (int i = 0; i < s.visManager->data().hinuma_atom_numbers.size(); i++) {
     const Eigen::Matrix<int, Eigen::Dynamic, 1> &id_vec = s.visManager->data().hinuma_atom_numbers;
     const Eigen::Matrix<float, Eigen::Dynamic, 4> &vectors = s.visManager->data().hinuma_vectors;
 
-    auto const &elm_info = s.visManager->data().elementInfos.find(s.visManager->data().tags(id_vec[i]) & 255)->second;
+    const float atom_radius = s.element_table_.radius[s.visManager->data().tags(id_vec[i]) & 255];
 
     const float length = vectors(i, 3);
     const glm::vec3 hinuma_vec = normalize(glm::vec3{vectors(i, 0), vectors(i, 1), vectors(i, 2)});
@@ -327,7 +448,7 @@ void VectorType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
 
     const glm::vec3
         pos = glm::vec3{atom_positions(id_vec[i], 0), atom_positions(id_vec[i], 1), atom_positions(id_vec[i], 2)}
-        + hinuma_vec*elm_info.atomRadius*s.gConfig.atomSize + anti_stutter_offset;
+        + hinuma_vec*atom_radius*s.gConfig.atomSize + anti_stutter_offset;
 
     auto modelMatrix = glm::translate(glm::mat4{1.f}, pos);
     const auto rotationAxis = glm::cross(unit_vec, hinuma_vec);
@@ -355,35 +476,45 @@ void BondType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
                                                  GPUObjectData *objectSSBO,
                                                  GPUInstance *instanceSSBO) const {
   assert(isLoaded());
-  uint32_t object_index = firstIndex;
-  glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
-  const auto &bonds = s.visManager->data().bonds[movieFrameIndex];
-  for (const auto &bond : bonds) {
-    const glm::vec3 pos = (bond.pos1 + bond.pos2)*0.5f;
-    const glm::vec3 displacement = bond.pos1 - bond.pos2;
-    const glm::vec3 cylinder = glm::vec3(0.f, 1.f, 0.f);
-    const glm::vec3 rotationAxis = glm::cross(displacement, cylinder);
-
-    const float length = glm::l2Norm(displacement);
-    const float angle = acosf(-glm::dot(displacement, cylinder)/length);
-
-    objectSSBO[object_index].color1 = glm::vec4(bond.color1, 1.f);
-    objectSSBO[object_index].color2 = glm::vec4(bond.color2, 1.f);
-    objectSSBO[object_index].bond_normal = glm::vec4(displacement, 0);
-    auto model_matrix = glm::translate(glm::mat4{1.0}, pos + anti_stutter_offset);
-    model_matrix = glm::rotate(model_matrix, angle, rotationAxis);
-    model_matrix = glm::scale(model_matrix,
-                              glm::vec3(s.gConfig.bondThickness,
-                                        length/2.f*s.gConfig.bondLength,
-                                        s.gConfig.bondThickness));
-    objectSSBO[object_index].modelMatrix = model_matrix;
-    objectSSBO[object_index].radius = s.meshes->meshInfos[meshID::eBond].radius*(length/2.f)*s.gConfig.bondLength;
-    objectSSBO[object_index].batchID = meshID::eBond;
-
-    instanceSSBO[object_index].object_id = object_index;
-    instanceSSBO[object_index].batch_id = meshID::eBond;
-    object_index++;
-  }
+  const glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
+  const auto &data = s.visManager->data();
+  const auto &bonds = data.frameBonds(movieFrameIndex);
+  const uint32_t bondCount = Count(movieFrameIndex);
+  const float bondThickness = s.gConfig.bondThickness;
+  const float bondLength = s.gConfig.bondLength;
+  const float meshRadius = s.meshes->meshInfos[meshID::eBond].radius;
+  const auto &colors = s.element_table_.color;
+
+  tbb::parallel_for(tbb::blocked_range<uint32_t>(0, bondCount, kWriteGrainSize),
+                    [&](const tbb::blocked_range<uint32_t> &range) {
+    for (uint32_t i = range.begin(); i < range.end(); i++) {
+      const auto [pos1, pos2] = data.bondPositions(movieFrameIndex, bonds[i]);
+      const glm::vec3 pos = (pos1 + pos2)*0.5f;
+      const glm::vec3 displacement = pos1 - pos2;
+      const glm::vec3 cylinder = glm::vec3(0.f, 1.f, 0.f);
+      const glm::vec3 rotationAxis = glm::cross(displacement, cylinder);
+
+      const float length = glm::l2Norm(displacement);
+      const float angle = acosf(-glm::dot(displacement, cylinder)/length);
+
+      // translate * rotate * scale, the translation and scale are applied to the columns directly
+      GPUObjectData object{};
+      object.modelMatrix = glm::rotate(glm::mat4{1.f}, angle, rotationAxis);
+      object.modelMatrix[0] *= bondThickness;
+      object.modelMatrix[1] *= length/2.f*bondLength;
+      object.modelMatrix[2] *= bondThickness;
+      object.modelMatrix[3] = glm::vec4(pos + anti_stutter_offset, 1.f);
+      object.color1 = colors[data.tags[bonds[i].atom1] & 255];
+      object.color2 = colors[data.tags[bonds[i].atom2] & 255];
+      object.bond_normal = glm::vec4(displacement, 0);
+      object.radius = meshRadius*(length/2.f)*bondLength;
+      object.batchID = meshID::eBond;
+
+      const uint32_t object_index = firstIndex + i;
+      objectSSBO[object_index] = object;
+      instanceSSBO[object_index] = GPUInstance{object_index, meshID::eBond};
+    }
+  });
 }
 
 void CylinderType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
@@ -393,7 +524,7 @@ void CylinderType::writeToObjectBufferAndIndexBuffer(uint32_t movieFrameIndex,
                                                      GPUInstance *instanceSSBO) const {
   uint32_t object_index = firstIndex;
 
-  const auto &atom_positions = s.visManager->data().positions[movieFrameIndex];
+  const auto atom_positions = s.visManager->data().positions[movieFrameIndex];
   glm::vec3 anti_stutter_offset = s.antiStutterOffset(movieFrameIndex);
 
   const auto &activeEvent = s.visManager->data().activeEvent;
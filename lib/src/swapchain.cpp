@@ -43,6 +43,7 @@ void Swapchain::init() {
   createImageViews();
   createRenderPass();
   createDepthRecourses();
+  createDepthPyramid();
   createFramebuffers();
 }
 
@@ -54,6 +55,12 @@ Swapchain::~Swapchain() {
   logicalDevice.destroy(depthImageView);
   vmaDestroyImage(allocator, depthImage.image, depthImage.allocation);
 
+  logicalDevice.destroy(depthSampler);
+  for (auto &mipView : depthPyramidMipViews) logicalDevice.destroy(mipView);
+  depthPyramidMipViews.clear();
+  logicalDevice.destroy(depthPyramidImageView);
+  vmaDestroyImage(allocator, depthPyramidImage.image, depthPyramidImage.allocation);
+
   logicalDevice.destroy(swapchain);
   swapchainImages.clear();
 
@@ -61,6 +68,8 @@ Swapchain::~Swapchain() {
   framebuffers.clear();
 
   logicalDevice.destroy(finalRenderPass);
+  logicalDevice.destroy(earlyPass);
+  logicalDevice.destroy(latePass);
 }
 
 SwapchainSupportCapabilities Swapchain::querySwapchainCapabilities() {
@@ -187,30 +196,45 @@ void Swapchain::createImageViews() {
 }
 
 void Swapchain::createRenderPass() {
+  using layout = vk::ImageLayout;
+  finalRenderPass = createRenderPass(vk::AttachmentLoadOp::eClear,
+                                     layout::eUndefined, layout::ePresentSrcKHR,
+                                     layout::eUndefined, layout::eDepthStencilAttachmentOptimal);
+  earlyPass = createRenderPass(vk::AttachmentLoadOp::eClear,
+                               layout::eUndefined, layout::eColorAttachmentOptimal,
+                               layout::eUndefined, layout::eShaderReadOnlyOptimal);
+  latePass = createRenderPass(vk::AttachmentLoadOp::eLoad,
+                              layout::eColorAttachmentOptimal, layout::ePresentSrcKHR,
+                              layout::eShaderReadOnlyOptimal, layout::eDepthStencilAttachmentOptimal);
+}
+
+vk::RenderPass Swapchain::createRenderPass(vk::AttachmentLoadOp loadOp,
+                                           vk::ImageLayout colorInitialLayout, vk::ImageLayout colorFinalLayout,
+                                           vk::ImageLayout depthInitialLayout, vk::ImageLayout depthFinalLayout) {
 
   //color attachment
   vk::AttachmentDescription colorAttachmentDescription{
       vk::AttachmentDescriptionFlags(),
       imageFormat,
       vk::SampleCountFlagBits::e1,
-      vk::AttachmentLoadOp::eClear,
+      loadOp,
       vk::AttachmentStoreOp::eStore,
       vk::AttachmentLoadOp::eDontCare,
       vk::AttachmentStoreOp::eDontCare,
-      vk::ImageLayout::eUndefined,
-      vk::ImageLayout::ePresentSrcKHR};
+      colorInitialLayout,
+      colorFinalLayout};
   vk::AttachmentReference colorReference{0, vk::ImageLayout::eColorAttachmentOptimal};
 
   vk::AttachmentDescription depth_attachment_description{
       vk::AttachmentDescriptionFlags(),
       chooseDepthFormat(),
       vk::SampleCountFlagBits::e1,
-      vk::AttachmentLoadOp::eClear,
+      loadOp,
       vk::AttachmentStoreOp::eStore,
       vk::AttachmentLoadOp::eDontCare,
       vk::AttachmentStoreOp::eDontCare,
-      vk::ImageLayout::eUndefined,
-      vk::ImageLayout::eDepthStencilAttachmentOptimal};
+      depthInitialLayout,
+      depthFinalLayout};
   vk::AttachmentReference depth_reference{1, vk::ImageLayout::eDepthStencilAttachmentOptimal};
 
   vk::SubpassDescription subpassDescription{
@@ -225,19 +249,41 @@ void Swapchain::createRenderPass() {
   // TODO CHECK IF SUBPASS DEPENDENCIES WERE REALLY UNNECESSARY
   // Check Out: https://www.reddit.com/r/vulkan/comments/s80reu/subpass_dependencies_what_are_those_and_why_do_i/
 
-  vk::SubpassDependency dependency{
-      VK_SUBPASS_EXTERNAL,
-      0,
-      vk::PipelineStageFlagBits::eColorAttachmentOutput,
-      vk::PipelineStageFlagBits::eColorAttachmentOutput,
-      {},
-      vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
-      {}
+  std::vector<vk::SubpassDependency> dependencies{
+      // the depth image is shared by all frames in flight, so depth writes of the previous frame are waited for too
+      vk::SubpassDependency{
+          VK_SUBPASS_EXTERNAL,
+          0,
+          vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests,
+          vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests,
+          vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+          vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+              | vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+          {}
+      }
   };
+  // the depth pyramid is built from the depth image between the early and the late pass
+  if (depthFinalLayout==vk::ImageLayout::eShaderReadOnlyOptimal) {
+    dependencies.emplace_back(0,
+                              VK_SUBPASS_EXTERNAL,
+                              vk::PipelineStageFlagBits::eLateFragmentTests,
+                              vk::PipelineStageFlagBits::eComputeShader,
+                              vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                              vk::AccessFlagBits::eShaderRead);
+  }
+  if (depthInitialLayout==vk::ImageLayout::eShaderReadOnlyOptimal) {
+    dependencies.emplace_back(VK_SUBPASS_EXTERNAL,
+                              0,
+                              vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+                              vk::AccessFlagBits::eShaderRead,
+                              vk::AccessFlagBits::eDepthStencilAttachmentRead
+                                  | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+  }
 
   vk::RenderPassCreateInfo renderPassInfo{
-      vk::RenderPassCreateFlags(), attachments, subpassDescription, dependency};
-  finalRenderPass = logicalDevice.createRenderPass(renderPassInfo);
+      vk::RenderPassCreateFlags(), attachments, subpassDescription, dependencies};
+  return logicalDevice.createRenderPass(renderPassInfo);
 }
 
 void Swapchain::createFramebuffers() {
@@ -264,7 +310,9 @@ void Swapchain::createDepthRecourses() {
   vk::Extent3D extent = {swapchainExtent.width, swapchainExtent.height, 1};
 
   auto depth_image_create_info = static_cast<VkImageCreateInfo>(
-      imageCreateInfo(depthFormat, vk::ImageUsageFlagBits::eDepthStencilAttachment, extent));
+      imageCreateInfo(depthFormat,
+                      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
+                      extent));
 
   VmaAllocationCreateInfo depth_image_alloc_info = {};
   depth_image_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -280,6 +328,47 @@ void Swapchain::createDepthRecourses() {
 
 }
 
+void Swapchain::createDepthPyramid() {
+  // next smaller power of two, so every level is exactly half the size of the one below
+  const auto previousPow2 = [](uint32_t v) {
+    uint32_t result = 1;
+    while (result*2 <= v) result *= 2;
+    return result;
+  };
+  depthPyramidSize = vk::Extent2D{previousPow2(swapchainExtent.width), previousPow2(swapchainExtent.height)};
+  uint32_t levels = 1;
+  while ((std::max(depthPyramidSize.width, depthPyramidSize.height) >> levels) > 0) levels++;
+
+  auto pyramid_create_info = imageCreateInfo(vk::Format::eR32Sfloat,
+                                             vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+                                             {depthPyramidSize.width, depthPyramidSize.height, 1});
+  pyramid_create_info.mipLevels = levels;
+  auto pyramid_image_create_info = static_cast<VkImageCreateInfo>(pyramid_create_info);
+
+  VmaAllocationCreateInfo pyramid_alloc_info = {};
+  pyramid_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  pyramid_alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  vmaCreateImage(allocator, &pyramid_image_create_info, &pyramid_alloc_info,
+                 &depthPyramidImage.image, &depthPyramidImage.allocation, nullptr);
+
+  auto view_create_info = imageviewCreateInfo(vk::Format::eR32Sfloat, depthPyramidImage.image,
+                                              vk::ImageAspectFlagBits::eColor);
+  view_create_info.subresourceRange.levelCount = levels;
+  depthPyramidImageView = logicalDevice.createImageView(view_create_info);
+
+  view_create_info.subresourceRange.levelCount = 1;
+  depthPyramidMipViews.resize(levels);
+  for (uint32_t level = 0; level < levels; level++) {
+    view_create_info.subresourceRange.baseMipLevel = level;
+    depthPyramidMipViews[level] = logicalDevice.createImageView(view_create_info);
+  }
+
+  // the shaders only use texelFetch, the sampler just has to exist
+  auto sampler_info = samplerCreateInfo(vk::Filter::eNearest, vk::SamplerAddressMode::eClampToEdge);
+  sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+  depthSampler = logicalDevice.createSampler(sampler_info);
+}
+
 vk::Format Swapchain::chooseDepthFormat() {
   std::vector<vk::Format> candidates{vk::Format::eD32Sfloat, vk::Format::eD24UnormS8Uint, vk::Format::eD32SfloatS8Uint};
   for (vk::Format format : candidates) {
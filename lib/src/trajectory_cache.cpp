@@ -0,0 +1,210 @@
+#include "trajectory_cache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr char kMagic[8] = {'R', 'E', 'D', 'R', 'E', 'S', 'T', 'C'};
+
+template<typename T>
+void writeArray(std::ofstream &out, const T *data, size_t count) {
+  out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(sizeof(T)*count));
+}
+
+// madvise wants a page aligned start, the range begins at the page holding its first byte
+void adviseRange(void *mapping, uint64_t begin, uint64_t end, int advice) {
+  const auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  begin = begin/pageSize*pageSize;
+  if (begin < end) madvise(static_cast<char *>(mapping) + begin, end - begin, advice);
+}
+}
+
+namespace rcc {
+
+TrajectoryCache::TrajectoryCache(const std::string &dbFilepath, const int experimentID)
+    : dbFilepath_{dbFilepath},
+      filepath_{dbFilepath + "." + std::to_string(experimentID) + ".redres-cache"},
+      experimentID_{experimentID} {}
+
+bool TrajectoryCache::databaseStamp(int64_t &modificationTime, uint64_t &size) const {
+  struct stat dbStat{};
+  if (stat(dbFilepath_.c_str(), &dbStat)!=0) return false;
+  modificationTime = static_cast<int64_t>(dbStat.st_mtim.tv_sec)*1'000'000'000 + dbStat.st_mtim.tv_nsec;
+  size = static_cast<uint64_t>(dbStat.st_size);
+
+  // in WAL mode committed writes only reach the database file with the next checkpoint
+  struct stat walStat{};
+  if (stat((dbFilepath_ + "-wal").c_str(), &walStat)==0) {
+    modificationTime = std::max(modificationTime,
+                                static_cast<int64_t>(walStat.st_mtim.tv_sec)*1'000'000'000 + walStat.st_mtim.tv_nsec);
+    size += static_cast<uint64_t>(walStat.st_size);
+  }
+  return true;
+}
+
+bool TrajectoryCache::isCurrent(const Header &header, const uint64_t fileSize) const {
+  int64_t modificationTime;
+  uint64_t dbSize;
+  if (!databaseStamp(modificationTime, dbSize)) return false;
+
+  const uint64_t positionBytes = uint64_t{header.frameCount}*header.atomCount*3*sizeof(float);
+  return std::memcmp(header.magic, kMagic, sizeof(kMagic))==0
+      && header.version==kVersion
+      && header.experimentID==experimentID_
+      && header.dbModificationTime==modificationTime
+      && header.dbSize==dbSize
+      && header.fileSize==fileSize
+      && header.frameCount > 0
+      && header.positionsOffset + positionBytes <= fileSize
+      && header.atomIDsOffset + uint64_t{header.atomCount}*sizeof(uint32_t) <= fileSize
+      && header.tagsOffset + uint64_t{header.atomCount}*sizeof(uint32_t) <= fileSize
+      && header.elementsOffset + uint64_t{header.elementCount}*sizeof(Element) <= fileSize;
+}
+
+bool TrajectoryCache::read(VisualizationData &vis, const bool mapPositions) const {
+  const int fd = open(filepath_.c_str(), O_RDONLY);
+  if (fd==-1) return false;
+  struct stat cacheStat{};
+  if (fstat(fd, &cacheStat)!=0 || static_cast<size_t>(cacheStat.st_size) < sizeof(Header)) {
+    close(fd);
+    return false;
+  }
+  const auto fileSize = static_cast<size_t>(cacheStat.st_size);
+  void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping==MAP_FAILED) return false;
+
+  const auto *bytes = static_cast<const char *>(mapping);
+  Header header{};
+  std::memcpy(&header, bytes, sizeof(Header));
+
+  if (!isCurrent(header, fileSize)) {
+    std::cout << "Trajectory cache " << filepath_ << " is outdated or invalid, reading from the database\n";
+    munmap(mapping, fileSize);
+    return false;
+  }
+  const uint64_t positionBytes = uint64_t{header.frameCount}*header.atomCount*3*sizeof(float);
+  // advice values are not flags and can't be combined. atom ids, tags and elements are copied right away, the
+  // positions are only prefetched when they are copied too. mapped ones are read at random by the FrameProvider
+  adviseRange(mapping, header.atomIDsOffset, fileSize, MADV_WILLNEED);
+
+  for (int i = 0; i < 9; i++) {
+    vis.unitCellEigen(i%3, i/3) = header.unitCell[i];
+  }
+  // unitCellGLM is filled with the untransposed matrix, see VisDataManager::loadUnitCell
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      vis.unitCellGLM[i][j] = vis.unitCellEigen(j, i);
+    }
+  }
+  vis.pbcBondVector = {header.pbc[0], header.pbc[1], header.pbc[2]};
+
+  vis.elementInfos.clear();
+  for (uint32_t i = 0; i < header.elementCount; i++) {
+    Element element{};
+    std::memcpy(&element, bytes + header.elementsOffset + i*sizeof(Element), sizeof(Element));
+    element.symbol[sizeof(element.symbol) - 1] = '\0';
+    vis.elementInfos[element.atomicNumber] =
+        ElementInfo{element.atomRadius, glm::vec3{element.color[0], element.color[1], element.color[2]},
+                    std::string(element.symbol)};
+  }
+
+  vis.atomIDs.resize(header.atomCount);
+  vis.tags.resize(header.atomCount);
+  std::memcpy(vis.atomIDs.data(), bytes + header.atomIDsOffset, header.atomCount*sizeof(uint32_t));
+  std::memcpy(vis.tags.data(), bytes + header.tagsOffset, header.atomCount*sizeof(uint32_t));
+
+  const bool isMapped =
+      mapPositions && vis.positions.map(filepath_, header.positionsOffset, header.frameCount, header.atomCount);
+  if (!isMapped) {
+    adviseRange(mapping, header.positionsOffset, header.positionsOffset + positionBytes, MADV_SEQUENTIAL);
+    adviseRange(mapping, header.positionsOffset, header.positionsOffset + positionBytes, MADV_WILLNEED);
+    vis.positions.allocate(header.frameCount, header.atomCount);
+    std::memcpy(vis.positions.data(), bytes + header.positionsOffset, positionBytes);
+  }
+
+  munmap(mapping, fileSize);
+  return true;
+}
+
+bool TrajectoryCache::mapPositions(VisualizationData &vis) const {
+  // the file may have been replaced or truncated since it was written, so it gets the same checks as in read
+  struct stat cacheStat{};
+  if (stat(filepath_.c_str(), &cacheStat)!=0) return false;
+  Header header{};
+  std::ifstream in(filepath_, std::ios::binary);
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(Header))) return false;
+  if (!isCurrent(header, static_cast<uint64_t>(cacheStat.st_size))) return false;
+  return vis.positions.map(filepath_, header.positionsOffset, header.frameCount, header.atomCount);
+}
+
+bool TrajectoryCache::write(const VisualizationData &vis) const {
+  if (vis.positions.empty()) return false;
+
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.experimentID = experimentID_;
+  if (!databaseStamp(header.dbModificationTime, header.dbSize)) return false;
+  header.frameCount = static_cast<uint32_t>(vis.positions.size());
+  header.atomCount = vis.positions.atomCount();
+  header.elementCount = static_cast<uint32_t>(vis.elementInfos.size());
+  for (int i = 0; i < 9; i++) {
+    header.unitCell[i] = vis.unitCellEigen(i%3, i/3);
+  }
+  for (int i = 0; i < 3; i++) {
+    header.pbc[i] = vis.pbcBondVector[i];
+  }
+
+  const uint64_t positionBytes = uint64_t{header.frameCount}*header.atomCount*3*sizeof(float);
+  // frames start cache line aligned, so a mapped frame can be used like an aligned Eigen matrix
+  header.positionsOffset = (sizeof(Header) + 63)/64*64;
+  header.atomIDsOffset = header.positionsOffset + positionBytes;
+  header.tagsOffset = header.atomIDsOffset + header.atomCount*sizeof(uint32_t);
+  header.elementsOffset = header.tagsOffset + header.atomCount*sizeof(uint32_t);
+  header.fileSize = header.elementsOffset + header.elementCount*sizeof(Element);
+
+  // write to a temporary file first, a crash while writing must not leave a truncated cache behind
+  const std::string temporaryFilepath = filepath_ + ".tmp";
+  {
+    std::ofstream out(temporaryFilepath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      std::cerr << "Could not write trajectory cache: " << temporaryFilepath << "\n";
+      return false;
+    }
+    writeArray(out, &header, 1);
+    const std::vector<char> headerPadding(header.positionsOffset - sizeof(Header), 0);
+    writeArray(out, headerPadding.data(), headerPadding.size());
+    writeArray(out, vis.positions.data(), vis.positions.size()*vis.positions.frameStride());
+    writeArray(out, vis.atomIDs.data(), header.atomCount);
+    writeArray(out, vis.tags.data(), header.atomCount);
+    for (const auto &[atomicNumber, info] : vis.elementInfos) {
+      Element element{};
+      element.atomicNumber = atomicNumber;
+      element.atomRadius = info.atomRadius;
+      element.color[0] = info.color[0];
+      element.color[1] = info.color[1];
+      element.color[2] = info.color[2];
+      std::strncpy(element.symbol, info.symbol.c_str(), sizeof(element.symbol) - 1);
+      writeArray(out, &element, 1);
+    }
+    if (!out) {
+      std::cerr << "Could not write trajectory cache: " << temporaryFilepath << "\n";
+      std::remove(temporaryFilepath.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporaryFilepath.c_str(), filepath_.c_str())!=0) {
+    std::remove(temporaryFilepath.c_str());
+    return false;
+  }
+  std::cout << "Wrote trajectory cache: " << filepath_ << "\n";
+  return true;
+}
+
+} // namespace rcc
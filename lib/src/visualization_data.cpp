@@ -3,8 +3,11 @@
 //
 
 #include "visualization_data.hpp"
+#include "bond_cache.hpp"
+#include "cell_list.hpp"
 #include <algorithm>
 #include <execution>
+#include <iterator>
 #include <glm/gtx/string_cast.hpp>
 
 namespace {
@@ -32,39 +35,164 @@ inline glm::vec<m, float, glm::precision::highp> E2GLM(const Eigen::Matrix<T, m,
 
 namespace rcc {
 
-void VisualizationData::createBonds(const float fudgeFactor) {
-  bool isDiagonal = true;
+VisualizationData::VisualizationData() = default;
+VisualizationData::~VisualizationData() = default;
+
+bool VisualizationData::isOrthorhombicCell() const {
   const auto &cell = unitCellEigen;
   for (int i = 0; i < cell.rows(); i++) {
     for (int j = 0; j < cell.cols(); j++) {
       if (abs(cell(i, j)) >= 1e-4 && (i!=j)) {
-        isDiagonal = false;
+        return false;
       }
     }
   }
+  return true;
+}
 
-  bonds.resize(positions.size());
+void VisualizationData::createBonds(const float fudgeFactor, const BondSearchMode mode) {
+  bondCache.reset();
+  bondTopology = BondTopology{};
+  // the frames are appended to, bonds of an earlier search must not stay in them
+  bonds.assign(positions.size(), {});
 
-  int estimatedBondAtomRatio = 6;
-  for (int i = 0; i < bonds.size(); i++) {
-    bonds[i].reserve(positions[i].rows()*estimatedBondAtomRatio);
-  }
   std::cout << "Cell:\n" << unitCellEigen << "\n";
-  if (isDiagonal) {
-    createBondsForRegularCell(fudgeFactor);
+  if (isOrthorhombicCell()) {
     std::cout << "Orthorhombic Cell detected" << std::endl;
   } else {
-    createBondsForNonRegularCell(fudgeFactor);
     std::cout << "Non Orthorhombic Cell detected" << std::endl;
   }
+  std::cout << "Bond search: " << (mode==BondSearchMode::eCellList ? "cell list" : "brute force") << std::endl;
+
+  std::for_each(std::execution::par_unseq, bonds.begin(), bonds.end(), [&](std::vector<Bond> &frame_bonds) {
+    const size_t i = &frame_bonds - &bonds[0];
+    createFrameBonds(i, fudgeFactor, mode, frame_bonds);
+    frame_bonds.shrink_to_fit();
+  });
+
+  maxBondCount = 0;
+  for (const auto &frame_bonds : bonds) {
+    maxBondCount = std::max(maxBondCount, static_cast<uint32_t>(frame_bonds.size()));
+  }
+}
+
+void VisualizationData::createLazyBonds(const float fudgeFactor,
+                                        const size_t cacheCapacity,
+                                        const uint32_t maxBondsPerAtom,
+                                        const BondSearchMode mode) {
+  bonds.clear();
+  bondTopology = BondTopology{};
+  // every bond belongs to two atoms
+  const uint32_t atomCount = positions.atomCount();
+  maxBondCount = atomCount*maxBondsPerAtom/2;
+
+  std::cout << "Cell:\n" << unitCellEigen << "\n";
+  std::cout << "Bonds are created on demand, cached frames: " << cacheCapacity << ", max bond count: "
+            << maxBondCount << std::endl;
+
+  bondCache = std::make_unique<BondFrameCache>(
+      [this, fudgeFactor, mode](uint32_t frameIndex, std::vector<Bond> &frameBonds) {
+        createFrameBonds(frameIndex, fudgeFactor, mode, frameBonds);
+        if (frameBonds.size() > maxBondCount) {
+          std::cerr << "Frame " << frameIndex << " has " << frameBonds.size() << " bonds, only the first "
+                    << maxBondCount << " are shown. Increase MaxBondsPerAtom in the settings.\n";
+        }
+      },
+      static_cast<uint32_t>(positions.size()),
+      cacheCapacity);
+}
+
+void VisualizationData::createStaticBondTopology(const float fudgeFactor,
+                                                 const size_t cacheCapacity,
+                                                 const BondSearchMode mode) {
+  bonds.clear();
+  bondTopology = BondTopology{};
+  maxBondCount = 0;
+  if (positions.empty()) return;
+
+  // the bonds of a frame are sorted by (atom1, atom2), so the deltas are plain set differences to the first frame
+  createFrameBonds(0, fudgeFactor, mode, bondTopology.reference);
+  bondTopology.reference.shrink_to_fit();
+  const auto &reference = bondTopology.reference;
 
-  for (auto &bond : bonds) {
-    bond.shrink_to_fit();
+  bondTopology.deltas.resize(positions.size());
+  std::for_each(std::execution::par_unseq, bondTopology.deltas.begin(), bondTopology.deltas.end(),
+                [&](BondTopology::FrameDelta &delta) {
+                  const size_t i = &delta - &bondTopology.deltas[0];
+                  if (i==0) return;
+                  std::vector<Bond> frameBonds;
+                  createFrameBonds(i, fudgeFactor, mode, frameBonds);
+                  std::set_difference(frameBonds.begin(), frameBonds.end(), reference.begin(), reference.end(),
+                                      std::back_inserter(delta.formed));
+                  std::set_difference(reference.begin(), reference.end(), frameBonds.begin(), frameBonds.end(),
+                                      std::back_inserter(delta.broken));
+                  delta.formed.shrink_to_fit();
+                  delta.broken.shrink_to_fit();
+                });
+
+  size_t deltaBondCount = 0;
+  for (const auto &delta : bondTopology.deltas) {
+    maxBondCount = std::max(maxBondCount,
+                            static_cast<uint32_t>(reference.size() + delta.formed.size() - delta.broken.size()));
+    deltaBondCount += delta.formed.size() + delta.broken.size();
   }
+  std::cout << "Static bond topology: " << reference.size() << " reference bonds, " << deltaBondCount
+            << " bonds in frame deltas" << std::endl;
+
+  bondCache = std::make_unique<BondFrameCache>(
+      [this](uint32_t frameIndex, std::vector<Bond> &frameBonds) { bondTopology.applyDelta(frameIndex, frameBonds); },
+      static_cast<uint32_t>(positions.size()),
+      cacheCapacity);
+}
+
+void BondTopology::applyDelta(const uint32_t frameIndex, std::vector<Bond> &frameBonds) const {
+  const auto &delta = deltas[frameIndex];
+  frameBonds.clear();
+  frameBonds.reserve(reference.size() + delta.formed.size() - delta.broken.size());
+  std::set_difference(reference.begin(), reference.end(), delta.broken.begin(), delta.broken.end(),
+                      std::back_inserter(frameBonds));
+  const auto middle = static_cast<std::ptrdiff_t>(frameBonds.size());
+  frameBonds.insert(frameBonds.end(), delta.formed.begin(), delta.formed.end());
+  std::inplace_merge(frameBonds.begin(), frameBonds.begin() + middle, frameBonds.end());
+}
+
+std::pair<glm::vec3, glm::vec3> VisualizationData::bondPositions(const uint32_t frameIndex, const Bond &bond) const {
+  const auto framePositions = positions[frameIndex];
+  const Eigen::Vector3f image{static_cast<float>(bond.image[0]), static_cast<float>(bond.image[1]),
+                              static_cast<float>(bond.image[2])};
+  const Eigen::Vector3f pos1 = framePositions.row(bond.atom1).transpose();
+  const Eigen::Vector3f pos2 = framePositions.row(bond.atom2).transpose() + unitCellEigen*image;
+  return {E2GLM(pos1), E2GLM(pos2)};
+}
+
+void VisualizationData::prefetchBonds(const uint32_t frameIndex, const int direction, const uint32_t window) const {
+  if (bondCache) bondCache->prefetch(frameIndex, direction, window);
+}
 
+const std::vector<Bond> &VisualizationData::frameBonds(const uint32_t frameIndex) const {
+  if (bondCache) return bondCache->get(frameIndex);
+  return bonds[frameIndex];
 }
 
-void VisualizationData::createBondsForNonRegularCell(const float fudgeFactor) {
+void VisualizationData::createFrameBonds(const uint32_t frameIndex,
+                                         const float fudgeFactor,
+                                         const BondSearchMode mode,
+                                         std::vector<Bond> &frameBonds) const {
+  const auto framePositions = positions[frameIndex];
+  const int estimatedBondAtomRatio = 6;
+  frameBonds.reserve(framePositions.rows()*estimatedBondAtomRatio);
+
+  if (isOrthorhombicCell()) {
+    createBondsForRegularCell(framePositions, fudgeFactor, mode, frameBonds);
+  } else {
+    createBondsForNonRegularCell(framePositions, fudgeFactor, mode, frameBonds);
+  }
+}
+
+void VisualizationData::createBondsForNonRegularCell(const FrameProvider::Frame &framePositions,
+                                                     const float fudgeFactor,
+                                                     const BondSearchMode mode,
+                                                     std::vector<Bond> &frameBonds) const {
   //unitCellEigen.transposeInPlace();
   const Eigen::Matrix3f inverseCellMatrix = unitCellEigen.inverse();
 
@@ -74,37 +202,47 @@ void VisualizationData::createBondsForNonRegularCell(const float fudgeFactor) {
   }
   const float squaredFudgeFactor = fudgeFactor*fudgeFactor;
   const float cutOff = squaredFudgeFactor*2.0f*maxAtomRadius;
+  // cutOff is compared against the squared distance, the small margin covers rounding at the bin borders
+  const float cutOffDistance = std::sqrt(cutOff)*1.01f;
 
-  std::for_each(std::execution::par_unseq, bonds.begin(), bonds.end(), [&](const std::vector<Bond> &frame_bonds) {
-    const size_t i = &frame_bonds - &bonds[0];
-    const auto &framePositions = positions[i];
-    std::vector<Bond> &frameBonds = bonds[i];
+  auto testPair = [&](uint32_t j, uint32_t k) {
+    const Eigen::Vector3f s_j = inverseCellMatrix*framePositions.row(j).transpose();
+    const Eigen::Vector3f s_k = inverseCellMatrix*framePositions.row(k).transpose();
+    Eigen::Vector3f s_jk = s_j - s_k;
+    const Eigen::Vector3f s_jk_mod = rint(s_jk.array()).matrix();
+
+    s_jk = s_jk - s_jk_mod;
+    const Eigen::Vector3f r_ij = unitCellEigen*s_jk;
+    const float squaredDistance = r_ij.squaredNorm();
 
+    if (squaredDistance < cutOff) {
+      const auto elmInfo1 = elementInfos.find(tags(j) & 255);
+      const auto elmInfo2 = elementInfos.find(tags(k) & 255);
+      // atoms of an element without an entry have no radius and get no bonds
+      if (elmInfo1==elementInfos.end() || elmInfo2==elementInfos.end()) return;
+      if (squaredDistance < squaredFudgeFactor*(elmInfo1->second.atomRadius + elmInfo2->second.atomRadius)) {
+        frameBonds.push_back(Bond{j, k, {static_cast<int16_t>(s_jk_mod(0)), static_cast<int16_t>(s_jk_mod(1)),
+                                         static_cast<int16_t>(s_jk_mod(2))}});
+      }
+    }
+  };
+
+  if (mode==BondSearchMode::eBruteForce) {
     for (uint32_t j = 0; j < framePositions.rows(); j++) {
       for (uint32_t k = j + 1; k < framePositions.rows(); k++) {
-
-        const Eigen::Vector3f s_j = inverseCellMatrix*framePositions.row(j).transpose();
-        const Eigen::Vector3f s_k = inverseCellMatrix*framePositions.row(k).transpose();
-        Eigen::Vector3f s_jk = s_j - s_k;
-        const Eigen::Vector3f s_jk_mod = rint(s_jk.array()).matrix();
-
-        s_jk = s_jk - s_jk_mod;
-        const Eigen::Vector3f r_ij = unitCellEigen*s_jk;
-        const float squaredDistance = r_ij.squaredNorm();
-
-        if (squaredDistance < cutOff) {
-          auto const &elmInfo1 = elementInfos[tags(j) & 255];
-          auto const &elmInfo2 = elementInfos[tags(k) & 255];
-          if (squaredDistance < squaredFudgeFactor*(elmInfo1.atomRadius + elmInfo2.atomRadius)) {
-            glm::vec3 pos1{framePositions.row(j)(0), framePositions.row(j)(1), framePositions.row(j)(2)};
-            glm::vec3 pos2{framePositions.row(j)(0) - r_ij(0), framePositions.row(j)(1) - r_ij(1),
-                           framePositions.row(j)(2) - r_ij(2)};
-            frameBonds.emplace_back(pos1, pos2, elmInfo1.color, elmInfo2.color);
-          }
-        }
+        testPair(j, k);
       }
     }
-  });
+    return;
+  }
+
+  // the bonds are always searched with the minimum image, so every direction is periodic here
+  CellList cellList(unitCellEigen, Eigen::Array3f::Ones(), cutOffDistance);
+  cellList.build(framePositions);
+  std::vector<uint32_t> candidates;
+  for (uint32_t j = 0; j < framePositions.rows(); j++) {
+    cellList.forEachCandidate(j, candidates, [&](uint32_t k) { testPair(j, k); });
+  }
 }
 
 // calc displacement vector between two atoms with mic
@@ -118,7 +256,10 @@ Eigen::Vector3f VisualizationData::calcMicDisplacementVec(const Eigen::Vector3f
   return unitCellEigen*s_jk;
 }
 
-void VisualizationData::createBondsForRegularCell(const float fudgeFactor) {
+void VisualizationData::createBondsForRegularCell(const FrameProvider::Frame &framePositions,
+                                                  const float fudgeFactor,
+                                                  const BondSearchMode mode,
+                                                  std::vector<Bond> &frameBonds) const {
   Eigen::Array3f BoxLengths = {unitCellEigen(0, 0), unitCellEigen(1, 1), unitCellEigen(2, 2)};
 
   float maxAtomRadius = 0;
@@ -128,33 +269,42 @@ void VisualizationData::createBondsForRegularCell(const float fudgeFactor) {
 
   const float squaredFudgeFactor = fudgeFactor*fudgeFactor;
   float cutOff = squaredFudgeFactor*2.f*maxAtomRadius;
+  const float cutOffDistance = std::sqrt(cutOff)*1.01f;
 
-  std::for_each(std::execution::par_unseq, bonds.begin(), bonds.end(), [&](const std::vector<Bond> &frame_bonds) {
+  auto testPair = [&](uint32_t j, uint32_t k) {
+    Eigen::Array3f r_ij = framePositions.row(j) - framePositions.row(k);
+    const Eigen::Array3f image = rint(r_ij/BoxLengths*pbcBondVector);
+    r_ij = r_ij - image*BoxLengths;
+    const float squaredDistance = r_ij.matrix().squaredNorm();
 
-    const size_t i = &frame_bonds - &bonds[0];
-    const auto &framePositions = positions[i];
-    std::vector<Bond> &frameBonds = bonds[i];
+    if (squaredDistance < cutOff) {
+      const auto elmInfo1 = elementInfos.find(tags(j) & 255);
+      const auto elmInfo2 = elementInfos.find(tags(k) & 255);
+      // atoms of an element without an entry have no radius and get no bonds
+      if (elmInfo1==elementInfos.end() || elmInfo2==elementInfos.end()) return;
+      if (squaredDistance < squaredFudgeFactor*(elmInfo1->second.atomRadius + elmInfo2->second.atomRadius)) {
+        frameBonds.push_back(Bond{j, k, {static_cast<int16_t>(image(0)), static_cast<int16_t>(image(1)),
+                                         static_cast<int16_t>(image(2))}});
+      }
+    }
+  };
 
+  if (mode==BondSearchMode::eBruteForce) {
     for (uint32_t j = 0; j < framePositions.rows(); j++) {
       for (uint32_t k = j + 1; k < framePositions.rows(); k++) {
-
-        Eigen::Array3f r_ij = framePositions.row(j) - framePositions.row(k);
-        r_ij = r_ij - rint(r_ij/BoxLengths*pbcBondVector)*BoxLengths;
-        const float squaredDistance = r_ij.matrix().squaredNorm();
-
-        if (squaredDistance < cutOff) {
-          auto const &elmInfo1 = elementInfos[tags(j) & 255];
-          auto const &elmInfo2 = elementInfos[tags(k) & 255];
-          if (squaredDistance < squaredFudgeFactor*(elmInfo1.atomRadius + elmInfo2.atomRadius)) {
-            const glm::vec3 pos1{framePositions.row(j)(0), framePositions.row(j)(1), framePositions.row(j)(2)};
-            const glm::vec3 pos2{framePositions.row(j)(0) - r_ij(0), framePositions.row(j)(1) - r_ij(1),
-                                 framePositions.row(j)(2) - r_ij(2)};
-            frameBonds.emplace_back(pos1, pos2, elmInfo1.color, elmInfo2.color);
-          }
-        }
+        testPair(j, k);
       }
     }
-  });
+    return;
+  }
+
+  // only the directions flagged in pbcBondVector wrap around
+  CellList cellList(unitCellEigen, pbcBondVector, cutOffDistance);
+  cellList.build(framePositions);
+  std::vector<uint32_t> candidates;
+  for (uint32_t j = 0; j < framePositions.rows(); j++) {
+    cellList.forEachCandidate(j, candidates, [&](uint32_t k) { testPair(j, k); });
+  }
 }
 
 } // namespace rcc
\ No newline at end of file
@@ -4,9 +4,14 @@
 
 
 #include "visualization_data_loader.hpp"
+#include "trajectory_cache.hpp"
 #include <Eigen/StdVector>
 #include <chrono>
 #include <execution>
+#include <thread>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/task_group.h>
 
 
 #define RCC_ACTIVATE_PRINT_TIMING
@@ -31,101 +36,223 @@ bool sqlCheck(int result) {
   }
   return result==SQLITE_OK;
 }
+
 }
 
 namespace rcc {
 
+ReadOnlyConnection::ReadOnlyConnection(const std::string &filepath) {
+  if (!sqlCheck(sqlite3_open_v2(filepath.c_str(), &db_, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr))) {
+    std::cerr << "Failed to open read only connection to: " << filepath << "\n";
+    return;
+  }
+  // a tag write holds the database lock while it commits
+  sqlite3_busy_timeout(db_, 5000);
+}
+
+ReadOnlyConnection::~ReadOnlyConnection() {
+  sqlite3_close(db_);
+}
+
 VisDataManager::VisDataManager(const std::string &db_filepath) : db_filepath_(db_filepath) {
     std::cout << "sqlite version: " << sqlite3_version << "\n";
     connectToDB();
 }
 
 int VisDataManager::getExperimentCount() {
-    sqlite3_stmt *query;
-    sqlCheck(sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM experiments", -1, &query, nullptr));
+    auto query = statement("SELECT COUNT(*) FROM experiments");
     sqlite3_step(query);
-    int count = sqlite3_column_int(query, 0);
-    sqlite3_finalize(query);
-    return count;
+    return sqlite3_column_int(query, 0);
 }
 
 int VisDataManager::getFirstExperimentID(){
-    sqlite3_stmt *query;
-    sqlCheck(sqlite3_prepare_v2(db, "SELECT id FROM experiments LIMIT 1", -1, &query, nullptr));
+    auto query = statement("SELECT id FROM experiments LIMIT 1");
     sqlite3_step(query);
-    int id = sqlite3_column_int(query, 0);
+    return sqlite3_column_int(query, 0);
+}
+
+CachedStatement VisDataManager::statement(const char *sql) const {
+  auto cached = statementCache_.find(sql);
+  if (cached==statementCache_.end()) {
+    sqlite3_stmt *query = nullptr;
+    // persistent: the statements are kept until the connection is closed
+    if (!sqlCheck(sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &query, nullptr))) {
+      std::cerr << "Failed to prepare statement: " << sql << "\n";
+      return CachedStatement(nullptr);
+    }
+    cached = statementCache_.emplace(sql, query).first;
+  }
+  return CachedStatement(cached->second);
+}
+
+void VisDataManager::finalizeStatements() {
+  for (auto &[sql, query] : statementCache_) {
     sqlite3_finalize(query);
-    return id;
+  }
+  statementCache_.clear();
+}
+
+int VisDataManager::lookupID(const char *sql, int &cachedID) const {
+  if (cachedID==-1) {
+    auto query = statement(sql);
+    if (sqlite3_step(query)==SQLITE_ROW) cachedID = sqlite3_column_int(query, 0);
+  }
+  return cachedID;
 }
 
 
 VisDataManager::~VisDataManager() {
+  unload();
+  waitForTagWrites();
+  sqlite3_close(writeDb);
   disconnectFromDB();
 }
 
-void VisDataManager::load(const int experiment_id) {
-
+void VisDataManager::beginLoad(const int experiment_id) {
   assert(vis==nullptr && "VisDataManager::load: vis is not nullptr. Did you forget to call unload() before?");
 
-  auto start_time = std::chrono::steady_clock::now();
   //get system and setting ids
   vis = std::make_unique<VisualizationData>();
-  sqlite3_stmt *query;
-  sqlCheck(sqlite3_prepare_v2(db, "SELECT system_id, setting_id FROM experiments WHERE id = ?", -1, &query, nullptr));
+  auto query = statement("SELECT system_id, setting_id FROM experiments WHERE id = ?");
   sqlite3_bind_int(query, 1, experiment_id);
   sqlite3_step(query);
 
   experimentID_ = experiment_id;
   systemID_ = sqlite3_column_int(query, 0);
   settingID_ = sqlite3_column_int(query, 1);
-  sqlite3_finalize(query);
 
-  RCC_PRINT_TIMING(loadUnitCell(systemID_))
-  RCC_PRINT_TIMING(loadElementInfos(systemID_))
-  RCC_PRINT_TIMING(loadAtomPositions(systemID_))
-  RCC_PRINT_TIMING(loadAtomElementNumbersAndTags(experimentID_);)
-  RCC_PRINT_TIMING(loadBonds(settingID_))
-  RCC_PRINT_TIMING(loadHinuma(experiment_id))
+  loadStage_ = LoadStage::eTopology;
+  tagsVersion_++;
+  loadedFrames_ = 0;
+  totalFrames_ = 0;
+  bondsLoaded_ = false;
+  cancelLoad_ = false;
+}
 
-  auto end_time = std::chrono::steady_clock::now();
-  std::chrono::duration<double> elapsed_seconds = end_time - start_time;
-  std::cout << "elapsed time for loading experiment Nr." << experiment_id << " and creating Bonds: "
-            << elapsed_seconds.count()*1000.f << "ms\n";
+void VisDataManager::load(const int experiment_id) {
+  beginLoad(experiment_id);
+  isBackgroundLoad_ = false;
+  loadData();
 }
 
-static int sqlPositionReaderCallBack(void *data, int, char **columns, char **) {
-  auto *helper = reinterpret_cast<SqlPositionReaderHelper *>(data);
+void VisDataManager::loadAsync(const int experiment_id) {
+  beginLoad(experiment_id);
+  isBackgroundLoad_ = true;
+  loadJob_ = std::async(std::launch::async, [this] { loadData(); });
+}
 
-  int &counter = helper->indexCounter;
-  const int frame = counter/helper->atomCount;
-  const int positionID = counter%helper->atomCount;
-  (*(helper->allPositions))[frame](positionID, 0) = strtof(columns[0], nullptr);
-  (*(helper->allPositions))[frame](positionID, 1) = strtof(columns[1], nullptr);
-  (*(helper->allPositions))[frame](positionID, 2) = strtof(columns[2], nullptr);
-  counter++;
-  return 0;
+void VisDataManager::waitForLoad() {
+  if (loadJob_.valid()) loadJob_.get();
 }
 
-void VisDataManager::loadAtomElementNumbersAndTags(int experimentID) {
+void VisDataManager::publishFrames(const uint32_t frameCount) {
+  loadedFrames_.store(frameCount, std::memory_order_release);
+}
+
+void VisDataManager::loadData() {
+  auto start_time = std::chrono::steady_clock::now();
+  // the background load never touches the connection of the render thread
+  ReadOnlyConnection connection(db_filepath_);
+
+  // hinuma vectors are not part of the trajectory cache, so they are read meanwhile
+  tbb::task_group hinumaTask;
+  hinumaTask.run([this] {
+    ReadOnlyConnection hinumaConnection(db_filepath_);
+    RCC_PRINT_TIMING(loadHinuma(hinumaConnection, experimentID_))
+  });
+
+  TrajectoryCache trajectoryCache(db_filepath_, experimentID_);
+  bool isCached = false;
+  if (useTrajectoryCache_) {
+    RCC_PRINT_TIMING(isCached = trajectoryCache.read(*vis, streamPositions_))
+  }
+  if (isCached) {
+    totalFrames_ = static_cast<uint32_t>(vis->positions.size());
+    hinumaTask.wait();
+    publishFrames(totalFrames_);
+  } else {
+    sqlite3_int64 firstPositionID;
+    RCC_PRINT_TIMING(firstPositionID = allocatePositions(connection, systemID_))
+    const auto frameCount = static_cast<uint32_t>(vis->positions.size());
+    totalFrames_ = frameCount;
+    loadStage_ = LoadStage::eFrames;
+
+    // every task reads through its own connection, the positions are split into frame ranges across the pool
+    const uint32_t connectionCount = std::max(1u, std::min(frameCount, loaderConnections_ ? loaderConnections_
+                                                                                          : std::thread::hardware_concurrency()));
+    std::vector<ReadOnlyConnection> connectionPool;
+    connectionPool.reserve(connectionCount);
+    for (uint32_t i = 0; i < connectionCount; i++) connectionPool.emplace_back(db_filepath_);
+
+    // frames are read in batches in playback order, after each batch the frames read so far can be displayed
+    const uint32_t batchSize = std::max(connectionCount, (frameCount + kLoadBatches - 1)/kLoadBatches);
+    const uint32_t firstBatchEnd = std::min(frameCount, batchSize);
+    const auto readTables = [&] {
+      tbb::parallel_invoke(
+          [this] {
+            ReadOnlyConnection unitCellConnection(db_filepath_);
+            RCC_PRINT_TIMING(loadUnitCell(unitCellConnection, systemID_))
+          },
+          [this] {
+            ReadOnlyConnection elementConnection(db_filepath_);
+            RCC_PRINT_TIMING(loadElementInfos(elementConnection, systemID_))
+          },
+          [this] {
+            ReadOnlyConnection tagConnection(db_filepath_);
+            RCC_PRINT_TIMING(loadAtomElementNumbersAndTags(tagConnection, experimentID_))
+          },
+          [&] { loadAtomPositions(connectionPool, firstPositionID, 0, firstBatchEnd); });
+      hinumaTask.wait();
+      publishFrames(firstBatchEnd);
+      for (uint32_t begin = firstBatchEnd; begin < frameCount && !cancelLoad_; begin += batchSize) {
+        const uint32_t end = std::min(frameCount, begin + batchSize);
+        loadAtomPositions(connectionPool, firstPositionID, begin, end);
+        publishFrames(end);
+      }
+    };
+    RCC_PRINT_TIMING(readTables())
+
+    if (useTrajectoryCache_ && !cancelLoad_) {
+      RCC_PRINT_TIMING(trajectoryCache.write(*vis))
+      // switch from the temporary frame file to the cache file, a background load has handed out the frames
+      // already, so it keeps the temporary file until the experiment is unloaded
+      if (streamPositions_ && !isBackgroundLoad_) trajectoryCache.mapPositions(*vis);
+    }
+  }
+
+  if (!cancelLoad_) {
+    loadStage_ = LoadStage::eBonds;
+    RCC_PRINT_TIMING(loadBonds(connection, settingID_))
+    bondsLoaded_.store(true, std::memory_order_release);
+  }
+  loadStage_ = LoadStage::eDone;
+
+  auto end_time = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end_time - start_time;
+  std::cout << "elapsed time for loading experiment Nr." << experimentID_ << " and creating Bonds: "
+            << elapsed_seconds.count()*1000.f << "ms\n";
+}
+
+void VisDataManager::loadAtomElementNumbersAndTags(sqlite3 *connection, int experimentID) {
   sqlite3_stmt *query;
 
   // get chemical and catalyst base_type_ids
-  sqlite3_prepare_v2(db, "SELECT id FROM base_types WHERE name=\"chemical\"", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT id FROM base_types WHERE name=\"chemical\"", -1, &query, nullptr);
   sqlite3_step(query);
   int chemicalID = sqlite3_column_int(query, 0);
   sqlite3_finalize(query);
 
-  sqlite3_prepare_v2(db, "SELECT id FROM base_types WHERE name=\"catalyst\"", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT id FROM base_types WHERE name=\"catalyst\"", -1, &query, nullptr);
   sqlite3_step(query);
   int catalystID = sqlite3_column_int(query, 0);
   sqlite3_finalize(query);
 
-  sqlite3_prepare_v2(db, "SELECT id FROM properties WHERE name=\"init_base_type\"", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT id FROM properties WHERE name=\"init_base_type\"", -1, &query, nullptr);
   sqlite3_step(query);
   int propertyID = sqlite3_column_int(query, 0);
   sqlite3_finalize(query);
 
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT atoms.id, atoms.atom_number, atoms.atomic_number, atom_tags.value FROM atoms INNER JOIN atom_tags on atoms.id = atom_tags.atom_id AND atom_tags.property_id = ? WHERE experiment_id = ?",
                      -1,
                      &query,
@@ -133,11 +260,11 @@ void VisDataManager::loadAtomElementNumbersAndTags(int experimentID) {
   sqlite3_bind_int(query, 1, propertyID);
   sqlite3_bind_int(query, 2, experimentID);
 
-  vis->atomIDs = Eigen::Vector<uint32_t, Eigen::Dynamic>::Zero(vis->positions[0].rows());
-  vis->tags = Eigen::Vector<uint32_t, Eigen::Dynamic>::Zero(vis->positions[0].rows());
+  vis->atomIDs = Eigen::Vector<uint32_t, Eigen::Dynamic>::Zero(vis->positions.atomCount());
+  vis->tags = Eigen::Vector<uint32_t, Eigen::Dynamic>::Zero(vis->positions.atomCount());
 
   while (sqlite3_step(query)!=SQLITE_DONE) {
-    const uint32_t atom_id = sqlite3_column_int(query, 1);
+    const uint32_t atom_id = sqlite3_column_int(query, 0);
     const uint32_t atom_number = sqlite3_column_int(query, 1);
     const uint32_t atomic_number = sqlite3_column_int(query, 2);
     const uint32_t base_type_id = sqlite3_column_int(query, 3);
@@ -151,13 +278,13 @@ void VisDataManager::loadAtomElementNumbersAndTags(int experimentID) {
   sqlite3_finalize(query);
 }
 
-void VisDataManager::loadAtomPositions(int systemID) {
+sqlite3_int64 VisDataManager::allocatePositions(sqlite3 *connection, int systemID) {
   sqlite3_stmt *query;
 
   //get FrameIndices
   std::vector<int> frameIDs;
   frameIDs.reserve(2000);
-  sqlite3_prepare_v2(db, "SELECT id FROM frames WHERE system_id = ?", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT id FROM frames WHERE system_id = ?", -1, &query, nullptr);
   sqlite3_bind_int(query, 1, systemID);
 
   while (sqlite3_step(query)!=SQLITE_DONE) {
@@ -167,34 +294,66 @@ void VisDataManager::loadAtomPositions(int systemID) {
   frameIDs.shrink_to_fit();
 
   //get MaxAtomCount
-  sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM atoms WHERE system_id = ?", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT COUNT(*) FROM atoms WHERE system_id = ?", -1, &query, nullptr);
   sqlite3_bind_int(query, 1, systemID);
   sqlite3_step(query);
   int maxAtomCount = sqlite3_column_int(query, 0);
   sqlite3_finalize(query);
 
   //resize all positions vector
-  std::vector<Eigen::Matrix<float, Eigen::Dynamic, 3>> &allPositions = vis->positions;
-  allPositions =
-      std::vector<Eigen::MatrixX3f>(frameIDs.size(), Eigen::Matrix<float, Eigen::Dynamic, 3>(maxAtomCount, 3));
-  SqlPositionReaderHelper helper{0, maxAtomCount, &allPositions};
-
-  sqlite3_prepare_v2(db, "SELECT MIN(id) FROM positions WHERE frame_id = ?", -1, &query, nullptr);
+  // when streaming, the frames are backed by a file so a trajectory larger than the memory can be read
+  vis->positions.allocate(static_cast<uint32_t>(frameIDs.size()),
+                          static_cast<uint32_t>(maxAtomCount),
+                          streamPositions_ ? db_filepath_ + ".frames.tmp" : "");
+  if (frameIDs.empty()) return 0;
+
+  // the positions of all frames follow each other without gaps, so the ids of every frame range follow from this one
+  sqlite3_prepare_v2(connection, "SELECT MIN(id) FROM positions WHERE frame_id = ?", -1, &query, nullptr);
   sqlite3_bind_int(query, 1, frameIDs[0]);
   sqlite3_step(query);
-  int firstID = sqlite3_column_int(query, 0);
+  const sqlite3_int64 firstPositionID = sqlite3_column_int64(query, 0);
   sqlite3_finalize(query);
+  return firstPositionID;
+}
 
-  sqlite3_prepare_v2(db, "SELECT MAX(id) FROM positions WHERE frame_id = ?", -1, &query, nullptr);
-  sqlite3_bind_int(query, 1, frameIDs[frameIDs.size() - 1]);
-  sqlite3_step(query);
-  int lastID = sqlite3_column_int(query, 0);
-  sqlite3_finalize(query);
+void VisDataManager::loadAtomPositions(std::vector<ReadOnlyConnection> &connections, sqlite3_int64 firstPositionID,
+                                       uint32_t firstFrame, uint32_t lastFrame) {
+  if (firstFrame >= lastFrame) return;
 
-  auto cmd3 = "SELECT x,y,z FROM positions WHERE id BETWEEN " + std::to_string(firstID)
-      + " AND " + std::to_string(lastID) + " ORDER BY id ASC";
+  const auto connectionCount = static_cast<uint32_t>(std::min<size_t>(connections.size(), lastFrame - firstFrame));
+  tbb::parallel_for(0u, connectionCount, [&](const uint32_t chunk) {
+    const uint32_t frameCount = lastFrame - firstFrame;
+    const uint32_t chunkBegin = firstFrame + static_cast<uint32_t>(uint64_t{frameCount}*chunk/connectionCount);
+    const uint32_t chunkEnd = firstFrame + static_cast<uint32_t>(uint64_t{frameCount}*(chunk + 1)/connectionCount);
+    loadFramePositions(connections[chunk], firstPositionID, chunkBegin, chunkEnd);
+  });
+}
 
-  sqlite3_exec(db, cmd3.c_str(), sqlPositionReaderCallBack, &helper, nullptr);
+void VisDataManager::loadFramePositions(sqlite3 *connection, sqlite3_int64 firstPositionID,
+                                        uint32_t firstFrame, uint32_t lastFrame) {
+  const size_t atomCount = vis->positions.atomCount();
+  sqlite3_stmt *query;
+  sqlite3_prepare_v2(connection,
+                     "SELECT x, y, z FROM positions WHERE id BETWEEN ? AND ? ORDER BY id ASC",
+                     -1,
+                     &query,
+                     nullptr);
+  sqlite3_bind_int64(query, 1, firstPositionID + static_cast<sqlite3_int64>(firstFrame*atomCount));
+  sqlite3_bind_int64(query, 2, firstPositionID + static_cast<sqlite3_int64>(lastFrame*atomCount) - 1);
+
+  // rows come frame by frame in atom order, each value goes straight into the x, y or z column of its frame block
+  float *positions = vis->positions.data();
+  size_t positionIndex = firstFrame*atomCount;
+  while (atomCount > 0 && sqlite3_step(query)==SQLITE_ROW) {
+    const size_t frame = positionIndex/atomCount;
+    const size_t atom = positionIndex%atomCount;
+    float *x = positions + frame*vis->positions.frameStride() + atom;
+    x[0] = static_cast<float>(sqlite3_column_double(query, 0));
+    x[atomCount] = static_cast<float>(sqlite3_column_double(query, 1));
+    x[2*atomCount] = static_cast<float>(sqlite3_column_double(query, 2));
+    positionIndex++;
+  }
+  sqlite3_finalize(query);
 }
 
 static glm::vec3 convertHexToRGB(uint32_t hex) {
@@ -213,10 +372,10 @@ static glm::vec3 convertHexStringToRGB(const char *hex_c_string) {
   return convertHexToRGB(std::stoul(hex_string, nullptr, 16));
 }
 
-void VisDataManager::loadElementInfos(int systemID) {
+void VisDataManager::loadElementInfos(sqlite3 *connection, int systemID) {
   // load the element numbers for the system
   sqlite3_stmt *query;
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT DISTINCT atomic_number FROM atoms WHERE system_id = ? ORDER BY atom_number",
                      -1,
                      &query,
@@ -224,7 +383,7 @@ void VisDataManager::loadElementInfos(int systemID) {
   sqlite3_bind_int(query, 1, systemID);
 
   sqlite3_stmt *elmInfoQuery;
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT chemical_symbol, covalent_radius_pyykko, cpk_color FROM elements WHERE id = ?",
                      -1,
                      &elmInfoQuery,
@@ -249,16 +408,16 @@ void VisDataManager::loadElementInfos(int systemID) {
   sqlite3_finalize(elmInfoQuery);
 }
 
-void VisDataManager::loadHinuma(int experimentID) {
+void VisDataManager::loadHinuma(sqlite3 *connection, int experimentID) {
   sqlite3_stmt *query;
 
-  sqlite3_prepare_v2(db, "SELECT id FROM hinuma WHERE experiment_id = ?", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT id FROM hinuma WHERE experiment_id = ?", -1, &query, nullptr);
   sqlite3_bind_int(query, 1, experimentID);
   sqlite3_step(query);
   int hinumaID = sqlite3_column_int(query, 0);
   sqlite3_finalize(query);
 
-  sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM hinuma_atoms WHERE hinuma_id = ?", -1, &query, nullptr);
+  sqlite3_prepare_v2(connection, "SELECT COUNT(*) FROM hinuma_atoms WHERE hinuma_id = ?", -1, &query, nullptr);
   sqlite3_bind_int(query, 1, hinumaID);
   sqlite3_step(query);
   int hinumaAtomCount = sqlite3_column_int(query, 0);
@@ -268,7 +427,7 @@ void VisDataManager::loadHinuma(int experimentID) {
   vis->hinuma_atom_numbers.resize(hinumaAtomCount, Eigen::NoChange);
   vis->hinuma_vectors.resize(hinumaAtomCount, Eigen::NoChange);
 
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT atoms.atom_number, hinuma_vec_x, hinuma_vec_y, hinuma_vec_z, solid_angle  FROM hinuma_atoms INNER JOIN atoms ON atom_id = atoms.id WHERE hinuma_id = ?",
                      -1,
                      &query,
@@ -277,18 +436,18 @@ void VisDataManager::loadHinuma(int experimentID) {
   int hinumaIndex = 0;
   while (sqlite3_step(query)!=SQLITE_DONE) {
     vis->hinuma_atom_numbers[hinumaIndex] = sqlite3_column_int(query, 0);
-    vis->hinuma_vectors(hinumaIndex, 0) = strtof((const char *) (sqlite3_column_text(query, 1)), nullptr);
-    vis->hinuma_vectors(hinumaIndex, 1) = strtof((const char *) (sqlite3_column_text(query, 2)), nullptr);
-    vis->hinuma_vectors(hinumaIndex, 2) = strtof((const char *) (sqlite3_column_text(query, 3)), nullptr);
-    vis->hinuma_vectors(hinumaIndex, 3) = strtof((const char *) (sqlite3_column_text(query, 4)), nullptr);
+    vis->hinuma_vectors(hinumaIndex, 0) = static_cast<float>(sqlite3_column_double(query, 1));
+    vis->hinuma_vectors(hinumaIndex, 1) = static_cast<float>(sqlite3_column_double(query, 2));
+    vis->hinuma_vectors(hinumaIndex, 2) = static_cast<float>(sqlite3_column_double(query, 3));
+    vis->hinuma_vectors(hinumaIndex, 3) = static_cast<float>(sqlite3_column_double(query, 4));
     hinumaIndex++;
   }
   sqlite3_finalize(query);
 }
 
-void VisDataManager::loadBonds(int settingID) {
+void VisDataManager::loadBonds(sqlite3 *connection, int settingID) {
   sqlite3_stmt *query;
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT value FROM setting_parameters WHERE setting_id = ? AND parameter_id = (SELECT id FROM parameters WHERE name = \"fudge_factor\")",
                      -1,
                      &query,
@@ -297,21 +456,23 @@ void VisDataManager::loadBonds(int settingID) {
   sqlite3_step(query);
 
   float fudgeFactor = strtof((const char *) (sqlite3_column_text(query, 0)), nullptr);
-  vis->createBonds(fudgeFactor);
+  if (bondSettings_.lazy) {
+    vis->createLazyBonds(fudgeFactor, bondSettings_.cachedFrames, bondSettings_.maxBondsPerAtom);
+  } else if (bondSettings_.staticTopology) {
+    vis->createStaticBondTopology(fudgeFactor, bondSettings_.cachedFrames);
+  } else {
+    vis->createBonds(fudgeFactor);
+  }
 
   sqlite3_finalize(query);
 }
 
 void VisDataManager::exportSettingText(int settingID, SettingsText &settings) {
-  sqlite3_stmt *query;
-  sqlite3_prepare_v2(db,
-                     "SELECT name, value, description FROM setting_parameters INNER JOIN parameters ON setting_parameters.parameter_id = parameters.id WHERE setting_id = ? ORDER BY parameter_id",
-                     -1,
-                     &query,
-                     nullptr);
+  auto query = statement(
+      "SELECT name, value, description FROM setting_parameters INNER JOIN parameters ON setting_parameters.parameter_id = parameters.id WHERE setting_id = ? ORDER BY parameter_id");
   sqlite3_bind_int(query, 1, settingID);
 
-  while (sqlite3_step(query)!=SQLITE_DONE) {
+  while (sqlite3_step(query)==SQLITE_ROW) {
     const char *name = (reinterpret_cast<const char *>(sqlite3_column_text(query, 0)));
     const char *value = (reinterpret_cast<const char *>(sqlite3_column_text(query, 1)));
     const char *description = (reinterpret_cast<const char *>(sqlite3_column_text(query, 2)));
@@ -321,20 +482,14 @@ void VisDataManager::exportSettingText(int settingID, SettingsText &settings) {
 
     settings.parameters.emplace_back(std::array<std::string, 3>{name_str, value_str, description_str});
   }
-
-  sqlite3_finalize(query);
 }
 
 void VisDataManager::exportEvents(int experimentID, EventsText &events) {
-  sqlite3_stmt *queryEvents;
-  sqlite3_prepare_v2(db,
-                     "SELECT events.id, frame_id, event_types.name, event_types.description FROM events INNER JOIN event_types ON event_type_id = event_types.id  WHERE experiment_id = ? ORDER BY frame_id",
-                     -1,
-                     &queryEvents,
-                     nullptr);
+  auto queryEvents = statement(
+      "SELECT events.id, frame_id, event_types.name, event_types.description FROM events INNER JOIN event_types ON event_type_id = event_types.id  WHERE experiment_id = ? ORDER BY frame_id");
 
   sqlite3_bind_int(queryEvents, 1, experimentID);
-  while (sqlite3_step(queryEvents)!=SQLITE_DONE) {
+  while (sqlite3_step(queryEvents)==SQLITE_ROW) {
     events.events.emplace_back(
         sqlite3_column_int(queryEvents, 0),
         sqlite3_column_int(queryEvents, 1),
@@ -342,23 +497,20 @@ void VisDataManager::exportEvents(int experimentID, EventsText &events) {
         std::string(reinterpret_cast<const char *>(sqlite3_column_text(queryEvents, 3)))
     );
   }
-  sqlite3_finalize(queryEvents);
 }
 
 void VisDataManager::exportExperimentIDTriplets(ExperimentIDTriplets &experiments) {
-  sqlite3_stmt *query;
-  sqlite3_prepare_v2(db, "SELECT id, system_id, setting_id FROM experiments", -1, &query, nullptr);
+  auto query = statement("SELECT id, system_id, setting_id FROM experiments");
 
-  while (sqlite3_step(query)!=SQLITE_DONE) {
+  while (sqlite3_step(query)==SQLITE_ROW) {
     experiments.experimentSystemSettingIDs.emplace_back(sqlite3_column_int(query, 0), sqlite3_column_int(query, 1),
                                                         sqlite3_column_int(query, 2));
   }
-  sqlite3_finalize(query);
 }
 
-void VisDataManager::loadUnitCell(int systemID) {
+void VisDataManager::loadUnitCell(sqlite3 *connection, int systemID) {
   sqlite3_stmt *query;
-  sqlite3_prepare_v2(db,
+  sqlite3_prepare_v2(connection,
                      "SELECT cell_1_x, cell_2_x, cell_3_x, cell_1_y, cell_2_y, cell_3_y, cell_1_z, cell_2_z, cell_3_z, pbc_x, pbc_y, pbc_z FROM systems WHERE id = ?",
                      -1,
                      &query,
@@ -366,15 +518,15 @@ void VisDataManager::loadUnitCell(int systemID) {
   sqlite3_bind_int(query, 1, systemID);
   sqlite3_step(query);
 
-  vis->unitCellEigen(0,0) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 0)), nullptr);
-  vis->unitCellEigen(1,0) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 1)), nullptr);
-  vis->unitCellEigen(2,0) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 2)), nullptr);
-  vis->unitCellEigen(0,1) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 3)), nullptr);
-  vis->unitCellEigen(1,1) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 4)), nullptr);
-  vis->unitCellEigen(2,1) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 5)), nullptr);
-  vis->unitCellEigen(0,2) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 6)), nullptr);
-  vis->unitCellEigen(1,2) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 7)), nullptr);
-  vis->unitCellEigen(2,2) = strtof(reinterpret_cast<const char *>(sqlite3_column_text(query, 8)), nullptr);
+  vis->unitCellEigen(0,0) = static_cast<float>(sqlite3_column_double(query, 0));
+  vis->unitCellEigen(1,0) = static_cast<float>(sqlite3_column_double(query, 1));
+  vis->unitCellEigen(2,0) = static_cast<float>(sqlite3_column_double(query, 2));
+  vis->unitCellEigen(0,1) = static_cast<float>(sqlite3_column_double(query, 3));
+  vis->unitCellEigen(1,1) = static_cast<float>(sqlite3_column_double(query, 4));
+  vis->unitCellEigen(2,1) = static_cast<float>(sqlite3_column_double(query, 5));
+  vis->unitCellEigen(0,2) = static_cast<float>(sqlite3_column_double(query, 6));
+  vis->unitCellEigen(1,2) = static_cast<float>(sqlite3_column_double(query, 7));
+  vis->unitCellEigen(2,2) = static_cast<float>(sqlite3_column_double(query, 8));
 
   for (int i = 0; i < 3; i++) {
     for (int j = 0; j < 3; j++) {
@@ -392,28 +544,23 @@ void VisDataManager::loadUnitCell(int systemID) {
 }
 
 void VisDataManager::loadActiveEvent(int eventID) {
-  sqlite3_stmt *query;
   vis->activeEvent = std::make_unique<Event>();
   vis->activeEvent->eventID = eventID;
 
-  sqlite3_prepare_v2(db,
-                     "SELECT frame_number, frames.id FROM frames INNER JOIN events ON frames.id = events.frame_id WHERE events.id = ?",
-                     -1,
-                     &query,
-                     nullptr);
-  sqlite3_bind_int(query, 1, eventID);
-  sqlite3_step(query);
-  vis->activeEvent->frameNumber = sqlite3_column_int(query, 0);
+  {
+    auto frameQuery = statement(
+        "SELECT frame_number, frames.id FROM frames INNER JOIN events ON frames.id = events.frame_id WHERE events.id = ?");
+    sqlite3_bind_int(frameQuery, 1, eventID);
+    sqlite3_step(frameQuery);
+    vis->activeEvent->frameNumber = sqlite3_column_int(frameQuery, 0);
+  }
 
-  sqlite3_prepare_v2(db,
-                     "SELECT atom_number FROM event_atoms INNER JOIN atoms on event_atoms.atom_id = atoms.id WHERE event_id = ?",
-                     -1,
-                     &query,
-                     nullptr);
+  auto query = statement(
+      "SELECT atom_number FROM event_atoms INNER JOIN atoms on event_atoms.atom_id = atoms.id WHERE event_id = ?");
   sqlite3_bind_int(query, 1, eventID);
 
 
-  while (sqlite3_step(query)!=SQLITE_DONE) {
+  while (sqlite3_step(query)==SQLITE_ROW) {
     int atomNumber = sqlite3_column_int(query, 0);
 
     if ((vis->tags[atomNumber] & Tags::eCatalyst) == Tags::eCatalyst) {
@@ -456,12 +603,10 @@ void VisDataManager::loadActiveEvent(int eventID) {
   Eigen::Vector3f n = vis->positions[vis->activeEvent->frameNumber].row(vis->activeEvent->catalyst_atom_numbers[0])
       - vis->positions[vis->activeEvent->frameNumber].row(vis->activeEvent->chemical_atom_numbers[0]);
   vis->activeEvent->connectionNormal = glm::normalize(glm::vec3{n(0), n(1), n(2)});
-
-  sqlite3_finalize(query);
-
 }
 
 void VisDataManager::addEventTags(const Event &event) {
+  tagsVersion_++;
   for (int atom_number : event.chemical_atom_numbers) {
     vis->tags(atom_number) |= Tags::eHighlighted;
   }
@@ -471,6 +616,7 @@ void VisDataManager::addEventTags(const Event &event) {
 }
 
 void VisDataManager::removeEventTags(const Event &event) {
+  tagsVersion_++;
   for (int atom_number : event.chemical_atom_numbers) {
     vis->tags(atom_number) &= (~Tags::eHighlighted);
   }
@@ -484,16 +630,19 @@ void VisDataManager::unloadActiveEvent() {
 }
 
 Eigen::Vector<uint32_t, Eigen::Dynamic> &VisDataManager::getTagsRef() {
+  tagsVersion_++;
   return vis->tags;
 }
 
 void VisDataManager::removeSelectedByAreaTags() {
+  tagsVersion_++;
   for (uint32_t &tag : vis->tags) {
     tag &= (~Tags::eSelectedForTagging);
   }
 }
 
 void VisDataManager::makeSelectedAreaChemical() {
+  tagsVersion_++;
   for (uint32_t &tag : vis->tags) {
     if ((tag & Tags::eSelectedForTagging) == Tags::eSelectedForTagging) {
       tag |= Tags::eChemical;
@@ -503,6 +652,7 @@ void VisDataManager::makeSelectedAreaChemical() {
 }
 
 void VisDataManager::makeSelectedAreaCatalyst() {
+  tagsVersion_++;
   for (uint32_t &tag : vis->tags) {
     if ((tag & Tags::eSelectedForTagging) == Tags::eSelectedForTagging) {
       tag |= Tags::eCatalyst;
@@ -513,70 +663,95 @@ void VisDataManager::makeSelectedAreaCatalyst() {
 
 
 int VisDataManager::getChemicalBaseTypeID() {
-  sqlite3_stmt *query;
-  sqlite3_prepare_v2(db, "SELECT id FROM base_types WHERE name=\"chemical\"", -1, &query, nullptr);
-  sqlite3_step(query);
-  int baseTypeID = sqlite3_column_int(query, 0);
-  sqlite3_finalize(query);
-  return baseTypeID;
+  return lookupID("SELECT id FROM base_types WHERE name=\"chemical\"", chemicalBaseTypeID_);
 }
 
 int VisDataManager::getCatalystBaseTypeID() {
-  sqlite3_stmt *query;
-  sqlite3_prepare_v2(db, "SELECT id FROM base_types WHERE name=\"catalyst\"", -1, &query, nullptr);
-  sqlite3_step(query);
-  int baseTypeID = sqlite3_column_int(query, 0);
-  sqlite3_finalize(query);
-  return baseTypeID;
+  return lookupID("SELECT id FROM base_types WHERE name=\"catalyst\"", catalystBaseTypeID_);
 }
 
 int VisDataManager::getBaseTypePropertyID() const{
-    sqlite3_stmt *query;
-    sqlite3_prepare_v2(db, "SELECT id FROM properties WHERE name=\"init_base_type\"", -1, &query, nullptr);
-    sqlite3_step(query);
-    int baseTypePropertyID = sqlite3_column_int(query, 0);
-    sqlite3_finalize(query);
-    return baseTypePropertyID;
+  return lookupID("SELECT id FROM properties WHERE name=\"init_base_type\"", baseTypePropertyID_);
 }
 
 void VisDataManager::updatePropertyForSelectedAtomsToDB(int experimentID, int propertyID, int value) {
-
-  disconnectFromDB();
-  connectToDB(SQLITE_OPEN_READWRITE);
-
-  sqlite3_stmt *transaction;
-  sqlite3_prepare_v2(db, "BEGIN TRANSACTION", -1, &transaction, nullptr);
-  sqlite3_step(transaction);
-  sqlite3_finalize(transaction);
-
-  sqlite3_stmt *query;
-  sqlite3_prepare_v2(db, "UPDATE atom_tags"
-                         " SET value = ? WHERE experiment_id = ? AND property_id = ?"
-                         " AND atom_id = ?", -1, &query, nullptr);
-
-
+  // the selected atoms are copied, so the tags can change while the write is running
+  std::vector<int> atomIDs;
   for (int i = 0; i < vis->atomIDs.size(); i++) {
-    if(vis->tags[i] & Tags::eSelectedForTagging){
-      sqlite3_bind_int(query, 1, value);
-      sqlite3_bind_int(query, 2, experimentID);
-      sqlite3_bind_int(query, 3, propertyID);
-      sqlite3_bind_int(query, 4, static_cast<int>(vis->atomIDs[i]));
-      sqlite3_step(query);
-      sqlite3_reset(query);
-    }
+    if (vis->tags[i] & Tags::eSelectedForTagging) atomIDs.push_back(static_cast<int>(vis->atomIDs[i]));
   }
+  if (atomIDs.empty()) return;
 
-  sqlite3_prepare_v2(db, "COMMIT TRANSACTION", -1, &transaction, nullptr);
-  sqlite3_step(transaction);
+  // writes run one after another on the read write connection, the render thread does not wait for them
+  tagWrite_ = std::async(std::launch::async,
+                         [this, previousWrite = tagWrite_, atomIDs = std::move(atomIDs), experimentID, propertyID,
+                          value] {
+                           if (previousWrite.valid()) previousWrite.wait();
+                           writePropertyForAtoms(atomIDs, experimentID, propertyID, value);
+                         }).share();
+}
 
-  sqlite3_finalize(query);
-  sqlite3_finalize(transaction);
+void VisDataManager::waitForTagWrites() {
+  if (tagWrite_.valid()) tagWrite_.wait();
+}
 
-  disconnectFromDB();
-  connectToDB();
+bool VisDataManager::connectForWriting() {
+  if (writeDb) return true;
+  if (!sqlCheck(sqlite3_open_v2(db_filepath_.c_str(), &writeDb, SQLITE_OPEN_READWRITE, nullptr))) {
+    std::cerr << "Failed to open database for writing: " << db_filepath_ << "\n";
+    sqlite3_close(writeDb);
+    writeDb = nullptr;
+    return false;
+  }
+  // the journal mode of the database is left as it is, it persists in the file. without a write ahead log the
+  // readers wait out the short commit, see the busy timeouts of the read connections
+  sqlite3_busy_timeout(writeDb, 5000);
+  sqlite3_exec(writeDb, "PRAGMA temp_store=MEMORY", nullptr, nullptr, nullptr);
+  sqlite3_exec(writeDb, "CREATE TEMP TABLE IF NOT EXISTS tagged_atoms(atom_id INTEGER PRIMARY KEY)",
+               nullptr, nullptr, nullptr);
+  return true;
+}
+
+void VisDataManager::writePropertyForAtoms(const std::vector<int> &atomIDs, int experimentID, int propertyID,
+                                           int value) {
+  if (!connectForWriting()) return;
+
+  if (!sqlCheck(sqlite3_exec(writeDb, "BEGIN IMMEDIATE TRANSACTION", nullptr, nullptr, nullptr))) return;
+  sqlite3_exec(writeDb, "DELETE FROM tagged_atoms", nullptr, nullptr, nullptr);
+
+  // collect the atoms in the temporary table and update all of their tags with a single statement
+  sqlite3_stmt *insert;
+  sqlite3_prepare_v2(writeDb, "INSERT OR IGNORE INTO tagged_atoms(atom_id) VALUES (?)", -1, &insert, nullptr);
+  for (const int atomID : atomIDs) {
+    sqlite3_bind_int(insert, 1, atomID);
+    sqlite3_step(insert);
+    sqlite3_reset(insert);
+  }
+  sqlite3_finalize(insert);
+
+  sqlite3_stmt *update;
+  sqlite3_prepare_v2(writeDb,
+                     "UPDATE atom_tags SET value = ? WHERE experiment_id = ? AND property_id = ?"
+                     " AND atom_id IN (SELECT atom_id FROM tagged_atoms)",
+                     -1,
+                     &update,
+                     nullptr);
+  sqlite3_bind_int(update, 1, value);
+  sqlite3_bind_int(update, 2, experimentID);
+  sqlite3_bind_int(update, 3, propertyID);
+  const bool isUpdated = sqlite3_step(update)==SQLITE_DONE;
+  sqlite3_finalize(update);
+
+  if (isUpdated) {
+    sqlCheck(sqlite3_exec(writeDb, "COMMIT TRANSACTION", nullptr, nullptr, nullptr));
+  } else {
+    std::cerr << "Failed to write tags: " << sqlite3_errmsg(writeDb) << "\n";
+    sqlite3_exec(writeDb, "ROLLBACK TRANSACTION", nullptr, nullptr, nullptr);
+  }
 }
 
 void VisDataManager::negateSelectedByAreaTags() {
+  tagsVersion_++;
   for (uint32_t &tag : vis->tags) {
     tag ^= Tags::eSelectedForTagging;
   }
@@ -585,6 +760,7 @@ void VisDataManager::negateSelectedByAreaTags() {
 void VisDataManager::connectToDB(int open_db_flags) {
   auto result = sqlite3_open_v2(db_filepath_.c_str(), &db, open_db_flags, nullptr);
   if(result == SQLITE_OK){
+    sqlite3_busy_timeout(db, 5000);
     std::cout << "Connected to database: " << db_filepath_ << std::endl;
   } else {
     std::cout << "Failed to connect to database:" <<  db_filepath_ << std::endl;
@@ -592,6 +768,8 @@ void VisDataManager::connectToDB(int open_db_flags) {
 }
 
 void VisDataManager::disconnectFromDB() {
+  // the connection can only be closed once all of its statements are finalized
+  finalizeStatements();
   auto result = sqlite3_close(db);
     if(result == SQLITE_OK){
         std::cout << "Disconnected from database: " << db_filepath_ << std::endl;
@@ -601,11 +779,18 @@ void VisDataManager::disconnectFromDB() {
 }
 
 void VisDataManager::removeSelectedForMeasurementTags() {
+    tagsVersion_++;
     for (uint32_t &tag : vis->tags) {
         tag &= (~Tags::eSelectedForMeasurement);
     }
 }
 void VisDataManager::unload() {
+  cancelLoad_ = true;
+  waitForLoad();
+  loadStage_ = LoadStage::eIdle;
+  loadedFrames_ = 0;
+  totalFrames_ = 0;
+  bondsLoaded_ = false;
   vis.reset(nullptr);
   experimentID_ = -1;
   systemID_ = -1;
@@ -0,0 +1,107 @@
+#include "visualization_data.hpp"
+#include <gtest/gtest.h>
+#include <random>
+
+namespace rcc {
+
+void PrintTo(const Bond &bond, std::ostream *os) {
+  *os << "(" << bond.atom1 << ", " << bond.atom2 << ", image " << bond.image[0] << " " << bond.image[1] << " "
+      << bond.image[2] << ")";
+}
+
+namespace {
+
+// atoms at random fractional coordinates of the cell, half hydrogen and half oxygen
+void fillRandomFrame(VisualizationData &data, const Eigen::Matrix3f &cell, const uint32_t atomCount,
+                     const uint32_t seed) {
+  data.unitCellEigen = cell;
+  data.elementInfos[1] = ElementInfo{0.6f, glm::vec3{1.f}, "H"};
+  data.elementInfos[8] = ElementInfo{0.7f, glm::vec3{1.f}, "O"};
+  data.positions.allocate(1, atomCount);
+  data.tags.resize(atomCount);
+
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> fraction(0.f, 1.f);
+  auto frame = data.positions.frame(0);
+  for (uint32_t i = 0; i < atomCount; i++) {
+    const Eigen::Vector3f position = cell*Eigen::Vector3f{fraction(generator), fraction(generator), fraction(generator)};
+    frame.row(i) = position.transpose();
+    data.tags(i) = (i%2==0) ? 1 : 8;
+  }
+}
+
+std::vector<Bond> searchBonds(VisualizationData &data, const BondSearchMode mode) {
+  data.createBonds(1.2f, mode);
+  return data.frameBonds(0);
+}
+
+TEST(BondSearch, CellListMatchesBruteForceInOrthorhombicCell) {
+  VisualizationData data;
+  fillRandomFrame(data, Eigen::Vector3f{10.f, 12.f, 9.f}.asDiagonal(), 400, 1);
+
+  const auto bruteForce = searchBonds(data, BondSearchMode::eBruteForce);
+  const auto cellList = searchBonds(data, BondSearchMode::eCellList);
+  ASSERT_FALSE(bruteForce.empty());
+  EXPECT_EQ(cellList, bruteForce);
+}
+
+TEST(BondSearch, CellListMatchesBruteForceInTriclinicCell) {
+  Eigen::Matrix3f cell;
+  cell << 10.f, 3.f, 1.f,
+          0.f, 9.f, 2.f,
+          0.f, 0.f, 11.f;
+  VisualizationData data;
+  fillRandomFrame(data, cell, 400, 2);
+
+  const auto bruteForce = searchBonds(data, BondSearchMode::eBruteForce);
+  const auto cellList = searchBonds(data, BondSearchMode::eCellList);
+  ASSERT_FALSE(bruteForce.empty());
+  EXPECT_EQ(cellList, bruteForce);
+}
+
+TEST(BondSearch, CellListMatchesBruteForceWithOpenDirection) {
+  VisualizationData data;
+  fillRandomFrame(data, Eigen::Vector3f{10.f, 10.f, 10.f}.asDiagonal(), 300, 3);
+  data.pbcBondVector = {1.f, 1.f, 0.f};
+
+  const auto bruteForce = searchBonds(data, BondSearchMode::eBruteForce);
+  const auto cellList = searchBonds(data, BondSearchMode::eCellList);
+  ASSERT_FALSE(bruteForce.empty());
+  EXPECT_EQ(cellList, bruteForce);
+  for (const auto &bond : cellList) EXPECT_EQ(bond.image[2], 0);
+}
+
+TEST(BondSearch, BondsCrossThePeriodicBoundary) {
+  VisualizationData data;
+  fillRandomFrame(data, Eigen::Vector3f{10.f, 10.f, 10.f}.asDiagonal(), 2, 4);
+  auto frame = data.positions.frame(0);
+  frame.row(0) = Eigen::RowVector3f{0.2f, 5.f, 5.f};
+  frame.row(1) = Eigen::RowVector3f{9.6f, 5.f, 5.f};
+
+  for (const auto mode : {BondSearchMode::eBruteForce, BondSearchMode::eCellList}) {
+    const auto bonds = searchBonds(data, mode);
+    ASSERT_EQ(bonds.size(), 1u);
+    EXPECT_EQ(bonds[0].image, (std::array<int16_t, 3>{-1, 0, 0}));
+  }
+}
+
+TEST(BondSearch, AtomsWithoutElementInfoGetNoBonds) {
+  VisualizationData data;
+  fillRandomFrame(data, Eigen::Vector3f{10.f, 10.f, 10.f}.asDiagonal(), 4, 5);
+  auto frame = data.positions.frame(0);
+  frame.row(0) = Eigen::RowVector3f{1.f, 1.f, 1.f};
+  frame.row(1) = Eigen::RowVector3f{1.5f, 1.f, 1.f};
+  frame.row(2) = Eigen::RowVector3f{5.f, 5.f, 5.f};
+  frame.row(3) = Eigen::RowVector3f{5.5f, 5.f, 5.f};
+  data.tags(2) = 99;
+
+  for (const auto mode : {BondSearchMode::eBruteForce, BondSearchMode::eCellList}) {
+    const auto bonds = searchBonds(data, mode);
+    ASSERT_EQ(bonds.size(), 1u);
+    EXPECT_EQ(bonds[0].atom1, 0u);
+    EXPECT_EQ(bonds[0].atom2, 1u);
+  }
+}
+
+} // namespace
+} // namespace rcc
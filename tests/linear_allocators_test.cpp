@@ -0,0 +1,141 @@
+#include "linear_allocators.hpp"
+#include <gtest/gtest.h>
+#include <deque>
+
+namespace rcc {
+namespace {
+
+TEST(StagingRing, AllocatesAlignedBackToBack) {
+  StagingRing ring;
+  ring.init(1024);
+  const auto a = ring.allocate(10);
+  const auto b = ring.allocate(20);
+  ASSERT_TRUE(a && b);
+  EXPECT_EQ(a->offset, 0u);
+  EXPECT_EQ(a->charged, 16u);
+  EXPECT_EQ(b->offset, 16u);
+  EXPECT_EQ(b->charged, 32u);
+  EXPECT_EQ(ring.used(), 48u);
+}
+
+TEST(StagingRing, FullRingRefusesUntilReleased) {
+  StagingRing ring;
+  ring.init(256);
+  const auto a = ring.allocate(128);
+  const auto b = ring.allocate(128);
+  ASSERT_TRUE(a && b);
+  EXPECT_FALSE(ring.allocate(16));
+
+  ring.release(a->charged);
+  const auto c = ring.allocate(64);
+  ASSERT_TRUE(c);
+  EXPECT_EQ(c->offset, 0u);
+}
+
+TEST(StagingRing, WrapChargesSkippedBytes) {
+  StagingRing ring;
+  ring.init(256);
+  const auto a = ring.allocate(96);
+  const auto b = ring.allocate(96);
+  ASSERT_TRUE(a && b);
+  ring.release(a->charged);
+
+  // 64 bytes are left behind the head, the copy starts at the front and pays for them
+  const auto c = ring.allocate(80);
+  ASSERT_TRUE(c);
+  EXPECT_EQ(c->offset, 0u);
+  EXPECT_EQ(c->charged, 80u + 64u);
+  EXPECT_EQ(ring.used(), 96u + 80u + 64u);
+
+  // the front is taken up to the live copy behind it
+  EXPECT_FALSE(ring.allocate(32));
+  ring.release(b->charged);
+  ring.release(c->charged);
+  EXPECT_EQ(ring.used(), 0u);
+}
+
+TEST(StagingRing, EmptyRingStartsOverAtTheFront) {
+  StagingRing ring;
+  ring.init(256);
+  const auto a = ring.allocate(200);
+  ASSERT_TRUE(a);
+  ring.release(a->charged);
+
+  const auto b = ring.allocate(200);
+  ASSERT_TRUE(b);
+  EXPECT_EQ(b->offset, 0u);
+  EXPECT_EQ(b->charged, 208u);
+}
+
+TEST(StagingRing, LiveCopiesNeverOverlap) {
+  StagingRing ring;
+  ring.init(1000);
+  struct Live {
+    uint64_t offset, size, charged;
+  };
+  std::deque<Live> live;
+  uint32_t state = 7;
+  for (int i = 0; i < 5000; i++) {
+    state = state*1664525u + 1013904223u;
+    const uint64_t size = 1 + (state >> 8)%300;
+    auto allocation = ring.allocate(size);
+    while (!allocation) {
+      // the oldest copy is done, like a batch retired by the timeline semaphore
+      ASSERT_FALSE(live.empty());
+      ring.release(live.front().charged);
+      live.pop_front();
+      allocation = ring.allocate(size);
+    }
+    ASSERT_LE(allocation->offset + size, ring.size());
+    ASSERT_EQ(allocation->offset%StagingRing::ALIGNMENT, 0u);
+    for (const auto &other : live) {
+      ASSERT_TRUE(allocation->offset + size <= other.offset || other.offset + other.size <= allocation->offset);
+    }
+    live.push_back({allocation->offset, size, allocation->charged});
+  }
+}
+
+TEST(FrameSlices, RoundsFramesToTheAlignment) {
+  FrameSlices slices;
+  EXPECT_EQ(slices.init(3, 1000, 256), 3u*1024u);
+  EXPECT_EQ(slices.frameSize(), 1024u);
+}
+
+TEST(FrameSlices, SlicesAreAlignedAndInsideTheirFrame) {
+  FrameSlices slices;
+  static_cast<void>(slices.init(3, 4096, 64));
+  for (uint32_t frame = 0; frame < 3; frame++) {
+    slices.beginFrame(frame);
+    uint64_t end = frame*slices.frameSize();
+    for (uint64_t size : {48u, 1u, 64u, 100u, 4u}) {
+      const uint64_t offset = slices.allocate(size);
+      EXPECT_EQ(offset%64, 0u);
+      EXPECT_GE(offset, end);
+      end = offset + size;
+      EXPECT_LE(end, (frame + 1)*slices.frameSize());
+    }
+  }
+}
+
+TEST(FrameSlices, BeginFrameStartsTheRegionOver) {
+  FrameSlices slices;
+  static_cast<void>(slices.init(2, 512, 16));
+  slices.beginFrame(1);
+  const uint64_t first = slices.allocate(40);
+  static_cast<void>(slices.allocate(40));
+  slices.beginFrame(1);
+  EXPECT_EQ(slices.allocate(40), first);
+  EXPECT_EQ(first, 512u);
+}
+
+TEST(FrameSlices, SmallAlignmentIsRaisedToFourBytes) {
+  FrameSlices slices;
+  static_cast<void>(slices.init(1, 64, 1));
+  EXPECT_EQ(slices.alignment(), 4u);
+  slices.beginFrame(0);
+  static_cast<void>(slices.allocate(3));
+  EXPECT_EQ(slices.allocate(3), 4u);
+}
+
+} // namespace
+} // namespace rcc
@@ -0,0 +1,44 @@
+#include "lod_ranges.hpp"
+#include <gtest/gtest.h>
+
+namespace rcc {
+namespace {
+
+TEST(LodRanges, PairsOfLevelsShareOneRange) {
+  LodInstanceRange ranges[4];
+  const uint32_t next = assignLodInstanceRanges(100, 10, 4, ranges);
+  EXPECT_EQ(next, 120u);
+
+  // levels 0 and 1 share [100, 110), 0 fills it from the front and 1 from the back
+  EXPECT_EQ(ranges[0].firstInstance, 100u);
+  EXPECT_EQ(ranges[0].rangeEnd, 110u);
+  EXPECT_EQ(ranges[1].firstInstance, 110u);
+  EXPECT_EQ(ranges[1].rangeEnd, 110u);
+  EXPECT_EQ(ranges[2].firstInstance, 110u);
+  EXPECT_EQ(ranges[2].rangeEnd, 120u);
+  EXPECT_EQ(ranges[3].firstInstance, 120u);
+  EXPECT_EQ(ranges[3].rangeEnd, 120u);
+}
+
+TEST(LodRanges, OddLevelCountGetsItsOwnLastRange) {
+  LodInstanceRange ranges[3];
+  EXPECT_EQ(assignLodInstanceRanges(0, 8, 3, ranges), 16u);
+  EXPECT_EQ(ranges[2].firstInstance, 8u);
+  EXPECT_EQ(ranges[2].rangeEnd, 16u);
+}
+
+TEST(LodRanges, MeshesFollowEachOtherWithoutOverlap) {
+  LodInstanceRange first[2], second[1];
+  const uint32_t afterFirst = assignLodInstanceRanges(0, 27*5, 2, first);
+  const uint32_t afterSecond = assignLodInstanceRanges(afterFirst, 27*3, 1, second);
+  EXPECT_EQ(afterFirst, 27u*5u);
+  EXPECT_EQ(second[0].firstInstance, afterFirst);
+  EXPECT_EQ(afterSecond, 27u*8u);
+}
+
+TEST(LodRanges, NoLevelsTakeNoInstances) {
+  EXPECT_EQ(assignLodInstanceRanges(7, 100, 0, nullptr), 7u);
+}
+
+} // namespace
+} // namespace rcc
@@ -0,0 +1,73 @@
+#include "slot_array.hpp"
+#include <gtest/gtest.h>
+
+namespace rcc {
+namespace {
+
+TEST(SlotArray, HandlesAreNeverZero) {
+  SlotArray<int> slots;
+  EXPECT_NE(slots.insert(1), 0u);
+  EXPECT_FALSE(slots.contains(0));
+}
+
+TEST(SlotArray, FreedSlotIsReusedWithNewGeneration) {
+  SlotArray<int> slots;
+  const uint32_t first = slots.insert(1);
+  slots.erase(first);
+  const uint32_t second = slots.insert(2);
+
+  EXPECT_EQ(first & SlotArray<int>::INDEX_MASK, second & SlotArray<int>::INDEX_MASK);
+  EXPECT_NE(first, second);
+  EXPECT_FALSE(slots.contains(first));
+  EXPECT_TRUE(slots.contains(second));
+  EXPECT_EQ(slots[second], 2);
+}
+
+TEST(SlotArray, StaleHandleAborts) {
+  SlotArray<int> slots;
+  const uint32_t handle = slots.insert(1);
+  slots.erase(handle);
+  EXPECT_DEATH(slots[handle], "");
+}
+
+TEST(SlotArray, ReferencesSurviveInserts) {
+  SlotArray<int> slots;
+  const uint32_t handle = slots.insert(42);
+  int &value = slots[handle];
+  for (int i = 0; i < 10000; i++) static_cast<void>(slots.insert(i));
+  EXPECT_EQ(&value, &slots[handle]);
+  EXPECT_EQ(value, 42);
+}
+
+TEST(SlotArray, ExhaustedGenerationRetiresSlot) {
+  SlotArray<int> slots;
+  const uint32_t first = slots.insert(0);
+  const uint32_t index = first & SlotArray<int>::INDEX_MASK;
+
+  // every reuse of the slot has to get a generation no earlier handle had
+  uint32_t handle = first;
+  for (uint32_t generation = 1; generation < SlotArray<int>::MAX_GENERATION; generation++) {
+    slots.erase(handle);
+    handle = slots.insert(0);
+    ASSERT_EQ(handle & SlotArray<int>::INDEX_MASK, index);
+    ASSERT_EQ(handle >> SlotArray<int>::INDEX_BITS, generation + 1);
+  }
+  slots.erase(handle);
+  EXPECT_NE(slots.insert(0) & SlotArray<int>::INDEX_MASK, index);
+  EXPECT_FALSE(slots.contains(first));
+}
+
+TEST(SlotArray, ForEachVisitsLiveValues) {
+  SlotArray<int> slots;
+  const uint32_t a = slots.insert(1);
+  static_cast<void>(slots.insert(2));
+  static_cast<void>(slots.insert(4));
+  slots.erase(a);
+
+  int sum = 0;
+  slots.forEach([&](int value) { sum += value; });
+  EXPECT_EQ(sum, 6);
+}
+
+} // namespace
+} // namespace rcc